@@ -7,34 +7,192 @@
 #define IOTCONNECT_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "iotconnect_event.h"
 #include "iotconnect_telemetry.h"
 #include "iotconnect_lib.h"
+#include "iotconnect_telemetry_writer.h"
+#include "iotconnect_outbox.h"
+#include "iotconnect_histogram.h"
+#include "iotconnect_metrics.h"
+#include "iotconnect_aggregate.h"
+#include "iotconnect_attributes.h"
+#include "iotconnect_sampler.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Telemetry batching limits. The batch is flushed as soon as any one of the limits is reached.
+// Set a limit to 0 to disable it. If all limits are 0, every data point is sent as soon as it is completed.
+typedef struct {
+    size_t max_bytes; // approximate size of the serialized packet
+    unsigned int max_points; // number of data points in the packet
+    uint32_t max_age_ms; // age of the oldest data point in the packet. Requires iotconnect_sdk_batch_poll() calls.
+} IotConnectBatchConfig;
+
+// Limits the rate of the telemetry batches with a token bucket, so that the back end does not throttle or disconnect the device.
+// A batch that reaches its limits before the rate limit allows it keeps collecting data points, and is sent by
+// the first iotconnect_sdk_batch_end_point() or iotconnect_sdk_batch_poll() call after that.
+// Acks and the messages sent with iotconnect_sdk_send_packet() or iotconnect_sdk_send_ack() are not limited.
+typedef struct {
+    uint32_t interval_ms; // average time between the batches. 0 uses the data frequency from the sync response.
+    unsigned int burst; // batches that can be sent back to back after a quiet period. 0 is the same as 1.
+    bool disabled; // send the batches as soon as the batch limits are reached
+} IotConnectRateLimit;
+
+typedef struct {
+    uint32_t sent; // telemetry batches sent, including the explicit flushes
+    uint32_t deferred; // batches that reached their limits, but were held back by the rate limit
+    uint32_t coalesced; // data points added to the batches that were held back
+    uint32_t dropped; // data points refused because a held back batch had IOTC_RATE_MAX_HELD_POINTS
+    uint32_t interval_ms; // interval in effect, or 0 if there is no limit
+} IotConnectRateStats;
+
+// How a message is delivered to the broker
+typedef enum {
+    IOTC_DELIVERY_DEFAULT = 0, // the default for the kind of message. See iotconnect_sdk_send_packet() and telemetry_delivery.
+    IOTC_DELIVERY_QOS0, // fire and forget. The message is dropped if the client is not connected.
+    IOTC_DELIVERY_QOS1, // acknowledged by the broker. The message is dropped if it cannot be sent.
+    IOTC_DELIVERY_QOS1_RETRY // QoS1, and kept in the outbox and sent after a reconnect if it cannot be sent. QoS1 without the outbox.
+} IotConnectDelivery;
+
+// A string that is not null terminated
+typedef struct {
+    const char *data;
+    size_t len;
+} IotConnectStringView;
+
+// Handles a command registered with iotconnect_sdk_register_command(). Called from the SDK's C2D task,
+// or from a worker task for the commands registered with iotconnect_sdk_register_async_command().
+// argv[0] is the command name and the rest are the space separated arguments. They are views into the event payload,
+// or into the SDK's copy of the command for async commands, that are valid until the handler returns. The last argument holds the rest of the line if there are more than
+// IOTC_COMMAND_MAX_ARGS words.
+// The arguments are the raw contents of the JSON string. Escape sequences, like \" or \u00e9, are not decoded,
+// and a quoted argument that contains spaces is split like any other.
+// Return true if the command succeeded. The SDK sends the ack with the optional ack_message,
+// which must stay valid after the handler returns, like a string literal.
+typedef bool (*IotConnectCommandHandler)(void *user_data, int argc, const IotConnectStringView *argv, const char **ack_message);
+
+typedef struct {
+    uint32_t submitted; // async commands handed to the workers
+    uint32_t rejected; // async commands that got a failure ack because too many were pending
+    uint32_t completed; // async commands that were acked when the handler returned
+    uint32_t timed_out; // async commands that got a failure ack when the timeout passed
+    IotConnectHistogram queue_time_ms; // time from the arrival of a command until a worker started it
+    IotConnectHistogram run_time_ms; // handler run time, including the handlers that ran past the timeout
+} IotConnectCommandStats;
+
 typedef struct {
     char *env;    // Environment name. Contact your representative for details.
     char *cpid;   // Settings -> Company Profile.
     char *duid;   // Name of the device.
     IotclOtaCallback ota_cb; // callback for OTA events.
-    IotclCommandCallback cmd_cb; // callback for command events.
+    IotclCommandCallback cmd_cb; // callback for command events that do not have a registered handler.
     IotclMessageCallback msg_cb; // callback for ALL messages, including the specific ones like cmd or ota callback.
+    IotConnectBatchConfig batch; // telemetry batching limits
+    IotConnectStorage *outbox_storage; // if set, messages that cannot be sent are stored here and sent once connected
+    IotConnectStorage *outbox_header_storage; // optional small storage for the outbox state. Use it with iotc_storage_lfs_open().
+    bool outbox_overwrite_oldest; // drop the oldest stored messages when the outbox is full, rather than the new ones
+    IotConnectDelivery telemetry_delivery; // for the telemetry batches. The default is IOTC_DELIVERY_QOS1_RETRY.
+    IotConnectRateLimit rate_limit; // for the telemetry batches
 } IotConnectClientConfig;
 
 IotConnectClientConfig *iotconnect_sdk_init_and_get_config();
 
 int iotconnect_sdk_init();
 
+// Registers a handler for the command with this name. Registering the same name again replaces the handler.
+// The name is not copied. Handlers should be registered before iotconnect_sdk_init().
+// Commands without a handler go to the cmd_cb in the config, or get a failure ack if there is no cmd_cb.
+int iotconnect_sdk_register_command(const char *name, IotConnectCommandHandler handler, void *user_data);
+
+// Same as iotconnect_sdk_register_command(), but the handler runs in one of IOTC_COMMAND_WORKERS worker tasks,
+// so a long running command does not hold up the later inbound messages. Acks are sent as each command finishes.
+// If the handler does not return within timeout_ms, a failure ack is sent and the handler's result is ignored.
+// If IOTC_COMMAND_MAX_PENDING commands are already queued or running, the command gets a failure ack right away.
+int iotconnect_sdk_register_async_command(const char *name, IotConnectCommandHandler handler, void *user_data, uint32_t timeout_ms);
+
+void iotconnect_sdk_get_command_stats(IotConnectCommandStats *stats);
+
+// Publishes the latency metrics from iotc_metrics_snapshot() as a single telemetry message with IOTC_DELIVERY_QOS0.
+// For each operation, the message has <name>_n, <name>_p50, <name>_p95, <name>_max (in ms) and <name>_fail, where
+// the name comes from iotc_metrics_name(). For each registered sampler, it also has <name>_jitter_p95 and <name>_jitter_max
+// (in ms), <name>_missed and <name>_dropped, and sampler_ring_hw for the ring high water mark.
+// Add those attributes to the device template for the values to show up.
+int iotconnect_sdk_send_metrics_report(void);
+
 bool iotconnect_sdk_is_connected();
 
 IotclConfig *iotconnect_sdk_get_lib_config();
 
+// Sends with IOTC_DELIVERY_QOS1_RETRY and waits for the PUBACK.
+// If the outbox is configured, the message is stored when it cannot be sent, or queued behind the stored messages,
+// and EXIT_SUCCESS is returned as long as it could be stored.
+// Messages longer than IOTC_OUTBOX_MAX_MESSAGE_SIZE cannot be stored, so they fail instead.
+// Use iotconnect_sdk_send_ack() for the command and OTA acks.
 int iotconnect_sdk_send_packet(const char *data);
 
+// Sends a command or OTA ack with QoS1 ahead of any stored messages, and waits for the PUBACK.
+// If the outbox is configured, the ack is stored only if it cannot be sent, and the outbox is not drained.
+int iotconnect_sdk_send_ack(const char *ack);
+
+// Sends with the given delivery. IOTC_DELIVERY_QOS1 and IOTC_DELIVERY_QOS1_RETRY wait for the PUBACK.
+// IOTC_DELIVERY_QOS0 returns as soon as the message is queued for sending.
+int iotconnect_sdk_send_packet_ex(const char *data, IotConnectDelivery delivery);
+
+// Same as iotconnect_sdk_send_packet_ex(), for messages that are not null terminated,
+// like the CBOR messages from the telemetry writer built with IOTC_TELEMETRY_WRITER_CBOR
+int iotconnect_sdk_send_packet_len(const char *data, size_t len, IotConnectDelivery delivery);
+
+// Sends the messages that were stored in the outbox while the client was disconnected.
+// This is called by the SDK on each send, but the application can call it right after a reconnect.
+// A message is removed from the outbox after its PUBACK, by the next drain. If a reset comes first, it is sent again.
+// It also stores the async messages that the broker did not take, which wait in RAM until the next drain.
+int iotconnect_sdk_outbox_drain(void);
+
+// Number of messages waiting in the outbox
+uint32_t iotconnect_sdk_outbox_count(void);
+
+void iotconnect_sdk_get_outbox_stats(IotConnectOutboxStats *stats);
+
+// Views into the payload of the event that is being processed, so that the command and OTA callbacks
+// can read the event fields without the allocations made by iotcl_clone_*().
+// Can be called only from the command, OTA or message callbacks, and the views are valid until the callback returns.
+// JSON escape sequences, like \/ in URLs, are not decoded.
+// Return EXIT_FAILURE if the event does not have the field.
+int iotconnect_sdk_event_get_command(IotConnectStringView *command);
+int iotconnect_sdk_event_get_download_url(unsigned int index, IotConnectStringView *url);
+int iotconnect_sdk_event_get_sw_version(IotConnectStringView *version);
+int iotconnect_sdk_event_get_ack_id(IotConnectStringView *ack_id);
+
+// Starts a new data point in the telemetry batch and returns the message handle
+// that should be used with iotcl_telemetry_set_* calls to populate the data point.
+// If iso_time is NULL, current time is used.
+// The batch stays locked until iotconnect_sdk_batch_end_point() is called.
+IotclMessageHandle iotconnect_sdk_batch_begin_point(const char *iso_time);
+
+// Completes the data point started with iotconnect_sdk_batch_begin_point()
+// and sends the batch if any of the configured limits is reached.
+int iotconnect_sdk_batch_end_point(void);
+
+// Sends the batch if its oldest data point has reached the configured max age. Call this periodically.
+int iotconnect_sdk_batch_poll(void);
+
+// Adds a data point to the telemetry batch with the values from the attribute table that are due to be reported.
+// Does nothing if no value is due. Call this after writing the values, or periodically for the max silence intervals.
+int iotconnect_sdk_batch_report_attributes(IotConnectAttributeTable *table);
+
+// Adds a data point to the telemetry batch with the window summaries once the aggregator's window closes.
+// Does nothing until then. Call this at least as often as the sub-window length, for example after adding the samples.
+int iotconnect_sdk_batch_report_aggregates(IotConnectAggregator *aggregator);
+
+// Sends any collected data points right away, even if the rate limit would hold them back.
+int iotconnect_sdk_batch_flush(void);
+
+void iotconnect_sdk_get_rate_stats(IotConnectRateStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,91 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_AGGREGATE_H
+#define IOTCONNECT_AGGREGATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_telemetry.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Number of equal bins between range_min and range_max used for the percentiles
+#ifndef IOTC_AGGREGATE_BINS
+#define IOTC_AGGREGATE_BINS 32
+#endif
+
+// Summaries that are reported for an attribute. Each one is reported as <name>_<suffix>.
+#define IOTC_AGGREGATE_COUNT  (1 << 0) // _n
+#define IOTC_AGGREGATE_MIN    (1 << 1) // _min
+#define IOTC_AGGREGATE_MAX    (1 << 2) // _max
+#define IOTC_AGGREGATE_MEAN   (1 << 3) // _mean
+#define IOTC_AGGREGATE_STDDEV (1 << 4) // _std, the sample standard deviation
+#define IOTC_AGGREGATE_P50    (1 << 5) // _p50
+#define IOTC_AGGREGATE_P90    (1 << 6) // _p90
+#define IOTC_AGGREGATE_P99    (1 << 7) // _p99
+#define IOTC_AGGREGATE_ALL    0xff
+
+typedef struct {
+    const char *name; // not copied
+    // The percentiles are interpolated within the bins, so they are accurate to (range_max - range_min) / IOTC_AGGREGATE_BINS.
+    // Values outside of the range are counted in the first or the last bin.
+    double range_min;
+    double range_max;
+    unsigned int outputs; // IOTC_AGGREGATE_* flags. 0 is the same as IOTC_AGGREGATE_ALL.
+} IotConnectAggregateAttribute;
+
+// Running statistics of one attribute over one sub-window. All fields are private.
+typedef struct {
+    uint32_t count;
+    double mean; // Welford's running mean
+    double m2; // and the sum of squared differences from it
+    double min;
+    double max;
+    uint32_t bins[IOTC_AGGREGATE_BINS];
+} IotConnectWindowStats;
+
+// Summarizes high rate samples over tumbling or sliding windows in constant memory.
+// A sliding window is made of sub_windows sub-windows, and it moves by one sub-window at a time.
+// With one sub-window, the windows are tumbling. The aggregator does no locking of its own. All fields are private.
+typedef struct {
+    const IotConnectAggregateAttribute *attrs;
+    size_t num_attrs;
+    IotConnectWindowStats *stats; // sub-window i of attribute a is at a * sub_windows + i
+    unsigned int sub_windows;
+    unsigned int current; // sub-window that the samples go into
+    uint32_t sub_window_ms;
+    uint32_t sub_window_end_ms;
+    bool started;
+} IotConnectAggregator;
+
+// attrs has num_attrs entries, and storage has num_attrs * sub_windows entries. Both must stay valid for the life of the aggregator.
+// window_ms should be a multiple of sub_windows.
+void iotc_aggregator_init(IotConnectAggregator *a, const IotConnectAggregateAttribute *attrs, size_t num_attrs,
+                          IotConnectWindowStats *storage, uint32_t window_ms, unsigned int sub_windows);
+
+// Adds a sample of the attribute at the index in the attrs array. Takes constant time.
+void iotc_aggregator_add(IotConnectAggregator *a, size_t index, double value);
+
+// Returns true once the current sub-window has ended at now_ms, and the window summary should be emitted.
+// The first call starts the first window.
+bool iotc_aggregator_due(IotConnectAggregator *a, uint32_t now_ms);
+
+// Returns true if any attribute has samples in the window. Call it before emitting to avoid empty data points.
+bool iotc_aggregator_has_samples(const IotConnectAggregator *a);
+
+// Sets the summaries of the window that just closed into the current data point of msg, and starts the next sub-window.
+// Attributes without samples in the window are skipped. Until the first full window, the summaries cover the time since the start.
+// msg is not used if the window has no samples, so it can be NULL then. Returns the number of values set.
+size_t iotc_aggregator_emit(IotConnectAggregator *a, IotclMessageHandle msg, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_AGGREGATE_H
@@ -0,0 +1,89 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_ATTRIBUTES_H
+#define IOTCONNECT_ATTRIBUTES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_telemetry.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Longer string values are truncated
+#ifndef IOTC_ATTRIBUTE_MAX_STRING_LEN
+#define IOTC_ATTRIBUTE_MAX_STRING_LEN 32
+#endif
+
+typedef enum {
+    IOTC_ATTRIBUTE_NUMBER = 0,
+    IOTC_ATTRIBUTE_BOOL,
+    IOTC_ATTRIBUTE_STRING
+} IotConnectAttributeType;
+
+typedef struct {
+    const char *name; // not copied
+    IotConnectAttributeType type;
+    // Numbers are reported when they move beyond the deadband around the last reported value.
+    // The deadband is the larger of deadband and deadband_percent of the last reported value. If both are 0, any change is reported.
+    // Other types are reported on any change.
+    double deadband;
+    double deadband_percent;
+    uint32_t max_silence_ms; // report the value at least this often, even if it does not change. 0 to report only changes.
+} IotConnectAttributeConfig;
+
+// All fields are private
+typedef struct {
+    const IotConnectAttributeConfig *config;
+    bool has_value; // written at least once
+    bool has_reported; // reported at least once
+    bool due; // changed beyond the deadband since the last report
+    uint32_t last_report_ms;
+    double number; // latest value
+    double reported_number;
+    char string[IOTC_ATTRIBUTE_MAX_STRING_LEN + 1];
+    char reported_string[IOTC_ATTRIBUTE_MAX_STRING_LEN + 1];
+} IotConnectAttribute;
+
+typedef struct {
+    uint32_t writes; // values written by the application
+    uint32_t reported; // values added to data points
+    uint32_t points; // data points emitted
+} IotConnectAttributeStats;
+
+// Report by exception. The application writes raw values as often as it likes, and only the values
+// that changed beyond their deadband, or were silent for too long, are reported.
+// Writes take constant time. The table does no locking of its own. All fields are private.
+typedef struct {
+    IotConnectAttribute *attrs;
+    size_t num_attrs;
+    size_t num_due;
+    IotConnectAttributeStats stats;
+} IotConnectAttributeTable;
+
+// configs and attrs are arrays of num_attrs entries. Both must stay valid for the life of the table.
+void iotc_attributes_init(IotConnectAttributeTable *t, IotConnectAttribute *attrs, const IotConnectAttributeConfig *configs, size_t num_attrs);
+
+// Write the latest value of the attribute at the index in the config array.
+// Return true if the value is due to be reported.
+bool iotc_attributes_set_number(IotConnectAttributeTable *t, size_t index, double value);
+bool iotc_attributes_set_bool(IotConnectAttributeTable *t, size_t index, bool value);
+bool iotc_attributes_set_string(IotConnectAttributeTable *t, size_t index, const char *value);
+
+// Returns true if any value changed beyond its deadband or reached its max silence at now_ms
+bool iotc_attributes_due(const IotConnectAttributeTable *t, uint32_t now_ms);
+
+// Sets the due values into the current data point of msg, where iotcl_telemetry_set_*() would be called otherwise,
+// and marks them reported. Returns the number of values set.
+size_t iotc_attributes_emit(IotConnectAttributeTable *t, IotclMessageHandle msg, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_ATTRIBUTES_H
@@ -0,0 +1,35 @@
+//
+// Copyright: Avnet 2022
+//
+// Generated by scripts/gen_cert_store.py from the files in the certs directory. Do not edit.
+//
+
+#ifndef IOTCONNECT_CERTS_DER_H
+#define IOTCONNECT_CERTS_DER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+typedef enum {
+    IOTC_CERT_NONE = 0, // not set. Zero initialized requests have no certificate rather than the first one.
+    IOTC_CERT_BALTIMORE_ROOT_CA = 1,
+    IOTC_CERT_GODADDY_SECURE_G2 = 2,
+    IOTC_CERT_BUILTIN_COUNT = 2
+} IotcCertId;
+
+typedef struct {
+    const unsigned char *der;
+    size_t der_len;
+} IotcDerCert;
+
+// Indexed by IotcCertId - 1
+extern const IotcDerCert iotc_builtin_certs[IOTC_CERT_BUILTIN_COUNT];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_CERTS_DER_H
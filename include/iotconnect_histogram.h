@@ -0,0 +1,43 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_HISTOGRAM_H
+#define IOTCONNECT_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+#ifndef IOTC_HISTOGRAM_BUCKETS
+#define IOTC_HISTOGRAM_BUCKETS 16
+#endif
+
+// Log scale histogram, typically of durations in milliseconds.
+// Bucket 0 counts zeros, bucket i counts values from 2^(i-1) to 2^i - 1,
+// and the last bucket counts everything larger. It does no locking of its own.
+typedef struct {
+    uint32_t buckets[IOTC_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} IotConnectHistogram;
+
+void iotc_histogram_add(IotConnectHistogram *h, uint32_t value);
+
+// Returns an upper bound for the given percentile (0-100), which is the top of the bucket that holds it,
+// but not more than the largest value seen. Returns 0 if the histogram is empty.
+uint32_t iotc_histogram_percentile(const IotConnectHistogram *h, unsigned int percentile);
+
+static inline uint32_t iotc_histogram_mean(const IotConnectHistogram *h) {
+    return h->count ? (uint32_t) (h->sum / h->count) : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_HISTOGRAM_H
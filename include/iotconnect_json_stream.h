@@ -0,0 +1,82 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_JSON_STREAM_H
+#define IOTCONNECT_JSON_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+#ifndef IOTC_JSON_STREAM_MAX_DEPTH
+#define IOTC_JSON_STREAM_MAX_DEPTH 8
+#endif
+
+#ifndef IOTC_JSON_STREAM_MAX_PATH_LEN
+#define IOTC_JSON_STREAM_MAX_PATH_LEN 64
+#endif
+
+// Values that are split across two chunks are assembled in a buffer of this size.
+// A longer split value fails the parsing.
+#ifndef IOTC_JSON_STREAM_MAX_VALUE_LEN
+#define IOTC_JSON_STREAM_MAX_VALUE_LEN 256
+#endif
+
+// Called for each scalar value whose path is in the list passed to iotc_json_stream_init().
+// path_index is the index of the matching path in that list.
+// For strings, value is the raw JSON string contents without the quotes. Escape sequences are not decoded.
+// For other values, value is the raw JSON text, like 123, true or null.
+// value points into the chunk that was passed to iotc_json_stream_feed() if the whole value was inside that chunk,
+// so it can be used as a view into the caller's buffer. The value is not null terminated.
+// Return false to stop the parsing.
+typedef bool (*IotConnectJsonValueCallback)(void *user_data, size_t path_index, const char *value, size_t value_len, bool is_string);
+
+// Incremental JSON scanner that picks out values at the given paths without building a tree.
+// Paths are dot separated object keys and array indices, like "d.p.h" or "data.urls.0.url".
+// All fields are private.
+typedef struct {
+    const char *const *paths;
+    size_t num_paths;
+    IotConnectJsonValueCallback cb;
+    void *user_data;
+
+    int state;
+    bool escape;
+    bool error;
+    bool done;
+    int depth;
+    struct {
+        bool is_array;
+        unsigned int index;
+        unsigned int path_len; // path length before this level's key or index
+    } stack[IOTC_JSON_STREAM_MAX_DEPTH];
+    char path[IOTC_JSON_STREAM_MAX_PATH_LEN + 1];
+    unsigned int path_len;
+    bool path_overflow;
+
+    int match; // index of the path of the value being scanned, or -1
+    const char *value_start; // start of the value in the current chunk, or NULL if it started in an earlier chunk
+    char value_buf[IOTC_JSON_STREAM_MAX_VALUE_LEN];
+    size_t value_len;
+    bool value_truncated;
+} IotConnectJsonStream;
+
+void iotc_json_stream_init(IotConnectJsonStream *js, const char *const *paths, size_t num_paths,
+                           IotConnectJsonValueCallback cb, void *user_data);
+
+// Scans the next chunk of the document. Returns false on a syntax error, a split value longer than
+// IOTC_JSON_STREAM_MAX_VALUE_LEN, or if the callback stopped the parsing.
+bool iotc_json_stream_feed(IotConnectJsonStream *js, const char *data, size_t len);
+
+// Returns true once the top level value has been fully scanned.
+bool iotc_json_stream_is_done(const IotConnectJsonStream *js);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_JSON_STREAM_H
@@ -0,0 +1,71 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_METRICS_H
+#define IOTCONNECT_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "iotconnect_histogram.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Recording a sample takes a short critical section, so the metrics can stay enabled in production.
+// Set to 0 to compile the recording out.
+#ifndef IOTC_METRICS_ENABLED
+#define IOTC_METRICS_ENABLED 1
+#endif
+
+typedef enum {
+    IOTC_METRIC_DISCOVERY = 0, // discovery HTTPS request
+    IOTC_METRIC_SYNC, // sync HTTPS request
+    IOTC_METRIC_TLS_CONNECT, // each DNS lookup, TCP connect and TLS handshake attempt of the HTTP client
+    IOTC_METRIC_HTTP_SEND, // each HTTP request and response exchange on an open connection
+    IOTC_METRIC_PUBLISH, // from handing a publish to the MQTT agent until the PUBACK, or until it is sent for QoS0
+    IOTC_METRIC_C2D, // processing of an inbound message, including the command and OTA callbacks
+    IOTC_METRIC_COUNT
+} IotConnectMetricId;
+
+typedef struct {
+    IotConnectHistogram latency_ms; // of all operations, including the failed ones
+    uint32_t failures;
+} IotConnectMetric;
+
+typedef struct {
+    IotConnectMetric metrics[IOTC_METRIC_COUNT]; // indexed by IotConnectMetricId
+} IotConnectMetricsSnapshot;
+
+// Short name, like "tls_connect", used in the self-report
+const char *iotc_metrics_name(IotConnectMetricId id);
+
+#if IOTC_METRICS_ENABLED
+
+// Returns the start time to pass to iotc_metrics_end()
+uint32_t iotc_metrics_start(void);
+
+void iotc_metrics_end(IotConnectMetricId id, uint32_t start, bool ok);
+
+void iotc_metrics_record(IotConnectMetricId id, uint32_t duration_ms, bool ok);
+
+#else
+
+static inline uint32_t iotc_metrics_start(void) { return 0; }
+static inline void iotc_metrics_end(IotConnectMetricId id, uint32_t start, bool ok) { (void) id; (void) start; (void) ok; }
+static inline void iotc_metrics_record(IotConnectMetricId id, uint32_t duration_ms, bool ok) { (void) id; (void) duration_ms; (void) ok; }
+
+#endif
+
+// Copies all metrics at once, so that they are consistent with each other
+void iotc_metrics_snapshot(IotConnectMetricsSnapshot *snapshot);
+
+void iotc_metrics_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_METRICS_H
@@ -0,0 +1,87 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_OUTBOX_H
+#define IOTCONNECT_OUTBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_storage.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+typedef struct {
+    uint32_t appended; // messages stored
+    uint32_t drained; // messages removed after they were sent
+    uint32_t overwritten; // oldest messages dropped to make room for new ones
+    uint32_t rejected; // messages that could not be stored
+    uint32_t append_time_total_ms; // time spent storing messages
+    uint32_t append_time_max_ms;
+    uint32_t drain_time_total_ms; // time spent sending stored messages
+} IotConnectOutboxStats;
+
+// Persistent ring log of outbound messages.
+// All fields are private. The outbox does no locking of its own.
+typedef struct {
+    IotConnectStorage *storage;
+    IotConnectStorage *header_storage; // the same as storage if the header is kept at its start
+    size_t data_offset; // start of the data area in storage
+    bool overwrite_oldest;
+    uint32_t head; // write offset in the data area
+    uint32_t tail; // read offset in the data area
+    uint32_t used; // bytes used in the data area
+    uint32_t count; // number of stored messages
+    uint32_t oldest_seq; // ID of the oldest message. The next ones have the following IDs. Not stored.
+    uint32_t sent; // offset of the oldest message that was not handed out by iotc_outbox_peek_unsent(). Not stored.
+    uint32_t sent_count; // messages between the oldest one and sent. Not stored.
+    IotConnectOutboxStats stats;
+} IotConnectOutbox;
+
+// Loads the outbox state from storage, or formats the storage if it does not contain a valid outbox.
+// The state is rewritten on every append and pop. If header_storage is set, the state is kept there and storage only
+// holds the messages, which suits a file system where rewriting the start of a file rewrites the whole file.
+// Otherwise the state is kept at the start of storage, which suits a raw flash region.
+// If overwrite_oldest is true, the oldest messages are dropped when there is no room for a new one.
+// Otherwise new messages are rejected when the outbox is full.
+int iotc_outbox_init(IotConnectOutbox *ob, IotConnectStorage *storage, IotConnectStorage *header_storage, bool overwrite_oldest);
+
+int iotc_outbox_append(IotConnectOutbox *ob, const void *data, size_t len);
+
+// Reads the oldest message into buf without removing it. len receives the message length.
+int iotc_outbox_peek(IotConnectOutbox *ob, void *buf, size_t buf_size, size_t *len);
+
+// Removes the oldest message.
+int iotc_outbox_pop(IotConnectOutbox *ob);
+
+// The functions below send the messages ahead of their removal, so that a message is removed only once the broker has it.
+// Reads the oldest message that is not marked as sent into buf. id receives the message ID.
+int iotc_outbox_peek_unsent(IotConnectOutbox *ob, void *buf, size_t buf_size, size_t *len, uint32_t *id);
+
+// Marks the message returned by iotc_outbox_peek_unsent() as sent, unless it was removed in the meantime
+void iotc_outbox_mark_sent(IotConnectOutbox *ob, uint32_t id, size_t len);
+
+// Removes the message with the given ID once it is acknowledged, if it is the oldest one.
+// Returns EXIT_FAILURE if it is not, in which case it stays in the outbox.
+int iotc_outbox_ack(IotConnectOutbox *ob, uint32_t id);
+
+// Marks all messages as not sent, so that they are sent again, starting with the oldest one
+void iotc_outbox_rewind(IotConnectOutbox *ob);
+
+static inline uint32_t iotc_outbox_unsent_count(const IotConnectOutbox *ob) {
+    return ob->count - ob->sent_count;
+}
+
+static inline uint32_t iotc_outbox_count(const IotConnectOutbox *ob) {
+    return ob->count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_OUTBOX_H
@@ -0,0 +1,83 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_SAMPLER_H
+#define IOTCONNECT_SAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_histogram.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+#ifndef IOTC_SAMPLER_MAX_SAMPLERS
+#define IOTC_SAMPLER_MAX_SAMPLERS 8
+#endif
+
+// Number of samples that the ring between the sampler task and the publishing task can hold
+#ifndef IOTC_SAMPLER_RING_SAMPLES
+#define IOTC_SAMPLER_RING_SAMPLES 64
+#endif
+
+// Called from the sampler task at the sampler's period. Should return quickly, as all samplers share the task.
+// Return false if no value could be read.
+typedef bool (*IotConnectSampleCallback)(void *user_data, double *value);
+
+typedef struct {
+    const char *name; // required and not copied. Used in the metrics report.
+    uint32_t period_ms; // rounded to whole ticks
+    IotConnectSampleCallback cb;
+    void *user_data;
+} IotConnectSamplerConfig;
+
+typedef struct {
+    uint32_t time_ms; // tick time when the value was read
+    uint16_t sampler; // id returned by iotc_sampler_register()
+    double value;
+} IotConnectSample;
+
+typedef struct {
+    uint32_t runs; // callback calls
+    uint32_t failures; // calls that returned false
+    uint32_t missed; // deadlines skipped because the sampler ran more than a period late
+    uint32_t dropped; // samples lost because the ring was full
+    IotConnectHistogram jitter_ms; // how late each call was past its deadline, in whole ticks
+} IotConnectSamplerStats;
+
+typedef struct {
+    uint32_t used; // samples in the ring now
+    uint32_t high_water; // most samples in the ring at the same time
+    uint32_t capacity; // IOTC_SAMPLER_RING_SAMPLES
+} IotConnectSampleRingStats;
+
+// Register all samplers before iotc_sampler_start(). The ids are assigned in order of registration, starting at 0.
+// Returns the id, or -1 if IOTC_SAMPLER_MAX_SAMPLERS are already registered or the sampler task has started.
+int iotc_sampler_register(const IotConnectSamplerConfig *config);
+
+// Starts the sampler task. Each sampler runs first right away, and then on fixed deadlines that are a multiple of its period
+// from the start, so a late call does not move the later ones.
+int iotc_sampler_start(void);
+
+// Takes up to max_samples samples from the ring. Waits up to wait_ms for the first one, but not for the rest.
+// The ring has a single reader, so only one task may call this. Returns the number of samples taken.
+size_t iotc_sampler_receive(IotConnectSample *samples, size_t max_samples, uint32_t wait_ms);
+
+int iotc_sampler_count(void);
+
+// Returns the name of the sampler, or NULL if the id is not registered
+const char *iotc_sampler_name(int id);
+
+void iotc_sampler_get_stats(int id, IotConnectSamplerStats *stats);
+
+void iotc_sampler_get_ring_stats(IotConnectSampleRingStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_SAMPLER_H
@@ -0,0 +1,40 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_STORAGE_H
+#define IOTCONNECT_STORAGE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// A fixed size region of persistent storage, like a flash partition or a file.
+// read, write and sync return 0 on success. Offsets are relative to the start of the region.
+// sync is optional. If set, the writes are only durable once sync returns, so a few writes can share the cost
+// of a sync. If NULL, each write is durable when it returns.
+typedef struct IotConnectStorage {
+    void *ctx;
+    size_t size;
+    int (*read)(void *ctx, size_t offset, void *buf, size_t len);
+    int (*write)(void *ctx, size_t offset, const void *buf, size_t len);
+    int (*sync)(void *ctx);
+} IotConnectStorage;
+
+static inline int iotc_storage_sync(IotConnectStorage *storage) {
+    return storage->sync ? storage->sync(storage->ctx) : 0;
+}
+
+// Storage backed by a stdio file. Intended for host builds and testing.
+// The file is created if it does not exist.
+int iotc_storage_file_open(IotConnectStorage *storage, const char *path, size_t size);
+
+void iotc_storage_file_close(IotConnectStorage *storage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_STORAGE_H
@@ -7,9 +7,42 @@
 #ifndef IOTCONNECT_SYNC_H
 #define IOTCONNECT_SYNC_H
 
+#include <stdint.h>
+#include "iotconnect_storage.h"
+
 #ifdef __cplusplus
 extern   "C" {
 #endif
+
+// Broker settings from a sync. A profile never changes once created. Each sync that succeeds replaces it with a new one.
+typedef struct {
+    uint32_t version; // increases with each profile
+    const char* host;
+    size_t host_len;
+    const char* client_id;
+    size_t client_id_len;
+    const char* user_name;
+    size_t user_name_len;
+    const char* pub_topic;
+    uint16_t pub_topic_len;
+    const char* sub_topic;
+    uint16_t sub_topic_len;
+    const char* dtg;
+    uint32_t data_frequency; // minimum time in seconds between telemetry messages, or 0 if not limited
+} IotConnectSyncProfile;
+
+// Returns the current profile, or NULL if no sync has completed. It never runs a sync.
+// The profile stays valid until it is released, even if a newer one replaces it in the meantime.
+const IotConnectSyncProfile* iotc_sync_acquire_profile(void);
+void iotc_sync_release_profile(const IotConnectSyncProfile* profile);
+
+// Takes another reference to a profile that the caller already holds, even if it is no longer the current one.
+// Must be released with iotc_sync_release_profile() like an acquired one. Returns the profile.
+const IotConnectSyncProfile* iotc_sync_retain_profile(const IotConnectSyncProfile* profile);
+
+// Fields of the current profile, or NULL if no sync has completed. They never run a sync.
+// The profile that they come from is kept for good, so the strings stay valid after a re-sync,
+// but iotc_sync_acquire_profile() should be used where the settings are read repeatedly.
 const char* iotc_sync_get_iothub_host();
 const char* iotc_sync_get_username(void);
 const char* iotc_sync_get_client_id(void);
@@ -17,9 +50,28 @@ const char* iotc_sync_get_pub_topic(void);
 const char* iotc_sync_get_sub_topic(void);
 const char* iotc_sync_get_dtg(void);
 
+// Minimum time in seconds between telemetry messages (the data frequency set for the device template), or 0 if not limited
+uint32_t iotc_sync_get_data_frequency(void);
+
+// Runs the sync, or loads it from the cache, and makes the result the current profile. Blocks on the HTTPS requests.
 int iotc_sync_obtain_response(void);
+
+// Drops the current profile. Profiles that are still acquired stay valid until they are released.
 void iotc_sync_free_response(void);
 
+// Runs a full sync in a background task and swaps in the new profile once it completes, so the caller does not block.
+// The current profile stays in use if the sync fails. The MQTT connection keeps its broker settings and topics until it reconnects.
+int iotc_sync_request_resync(void);
+
+// If set, the sync response is saved to this storage and reused on the next boot,
+// skipping the discovery and sync HTTPS requests until the cache expires or is invalidated.
+// Should be called before iotc_sync_obtain_response().
+void iotc_sync_set_cache_storage(IotConnectStorage* storage);
+
+// Forces a full sync on the next iotc_sync_obtain_response().
+// Should be called when the MQTT connection is refused or when the back end requests a sync.
+void iotc_sync_invalidate_cache(void);
+
 
 #ifdef __cplusplus
 }
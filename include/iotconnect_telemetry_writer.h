@@ -0,0 +1,84 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_TELEMETRY_WRITER_H
+#define IOTCONNECT_TELEMETRY_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// If 1, the writer produces CBOR (RFC 8949) rather than JSON. The message has the same structure and keys as the JSON one,
+// so it maps one to one to the JSON message, but it is smaller, mostly because the numbers are binary.
+// The back end must be set up to accept CBOR. As the message is binary, send it with iotconnect_sdk_send_packet_len().
+// The SDK's telemetry batches and metrics reports are converted to CBOR as well.
+#ifndef IOTC_TELEMETRY_WRITER_CBOR
+#define IOTC_TELEMETRY_WRITER_CBOR 0
+#endif
+
+// If 1, the data points after the first one carry "dt" as the number of milliseconds after the message time "t",
+// rather than as an ISO timestamp, which saves about 20 bytes per point. This applies to the points added with
+// iotc_telemetry_writer_add_point_at() or with a NULL time, if the first point was added the same way.
+// The back end must be set up to accept it.
+#ifndef IOTC_TELEMETRY_WRITER_RELATIVE_TIME
+#define IOTC_TELEMETRY_WRITER_RELATIVE_TIME 0
+#endif
+
+// Maximum length of the ISO timestamp string, like 2022-06-15T12:34:56.789Z
+#define IOTC_TELEMETRY_WRITER_TIME_MAX_LEN 32
+
+// Writes the IoTConnect telemetry message directly into a caller provided buffer
+// without any heap allocations. This is an alternative to the iotcl_telemetry_* API
+// where the data points are known to fit into a fixed size buffer.
+// All fields are private. Use the functions below to access the writer.
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    unsigned int num_points;
+    unsigned int num_values; // in the current point
+    bool overflow;
+    char first_time[IOTC_TELEMETRY_WRITER_TIME_MAX_LEN + 1];
+    uint64_t first_time_ms; // valid if has_first_time_ms
+    bool has_first_time_ms;
+} IotConnectTelemetryWriter;
+
+// Starts a new telemetry message in buf. The envelope is populated from the lib config.
+// Returns false if the buffer is too small.
+bool iotc_telemetry_writer_init(IotConnectTelemetryWriter *w, char *buf, size_t size);
+
+// Starts a new data point. If iso_time is NULL, current time is used.
+bool iotc_telemetry_writer_add_point(IotConnectTelemetryWriter *w, const char *iso_time);
+
+// Starts a new data point at the time from iotc_timestamp_now_ms(), in milliseconds since the epoch
+bool iotc_telemetry_writer_add_point_at(IotConnectTelemetryWriter *w, uint64_t time_ms);
+
+bool iotc_telemetry_writer_set_number(IotConnectTelemetryWriter *w, const char *name, double value);
+
+bool iotc_telemetry_writer_set_bool(IotConnectTelemetryWriter *w, const char *name, bool value);
+
+bool iotc_telemetry_writer_set_string(IotConnectTelemetryWriter *w, const char *name, const char *value);
+
+bool iotc_telemetry_writer_set_null(IotConnectTelemetryWriter *w, const char *name);
+
+// Completes the message and returns the null terminated string in the buffer passed to init,
+// or NULL if the message did not fit into the buffer or has no data points.
+// If len is not NULL, it receives the string length. A CBOR message can contain null bytes, so len must be used.
+const char *iotc_telemetry_writer_finish(IotConnectTelemetryWriter *w, size_t *len);
+
+// Writes a complete JSON message, like the one from iotcl_create_serialized_string(), into buf in the writer's format,
+// so that the messages built with the iotcl_telemetry_* API follow IOTC_TELEMETRY_WRITER_CBOR too.
+// The JSON message is copied as is, or converted to CBOR with the same structure.
+// Returns buf, or NULL if the message is not valid JSON or does not fit. len receives the message length.
+const char *iotc_telemetry_writer_encode_json(char *buf, size_t size, const char *json, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_TELEMETRY_WRITER_H
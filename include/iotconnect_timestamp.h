@@ -0,0 +1,44 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_TIMESTAMP_H
+#define IOTCONNECT_TIMESTAMP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Length of the ISO timestamp, like 2022-06-15T12:34:56.789Z, without the null terminator
+#define IOTC_TIMESTAMP_LEN 24
+
+// How often the tick based clock is compared with time(). It is corrected if it is more than a second off,
+// for example when the wall clock is set over the network. Until time() is past IOTC_TIMESTAMP_MIN_VALID_TIME,
+// it is compared on every call.
+#ifndef IOTC_TIMESTAMP_RESYNC_MS
+#define IOTC_TIMESTAMP_RESYNC_MS 60000
+#endif
+
+// time() values before this (2022-01-01) mean that the wall clock has not been set yet
+#define IOTC_TIMESTAMP_MIN_VALID_TIME 1640995200
+
+// Returns the wall clock time in milliseconds since the epoch. It comes from the tick count plus an offset taken from time(),
+// so it is cheap to call and has a millisecond resolution even if time() only counts seconds.
+uint64_t iotc_timestamp_now_ms(void);
+
+// Formats the time in the same format as iotcl_iso_timestamp_now(), but with the milliseconds.
+// The date and the hours and minutes are cached, so only the seconds and milliseconds are written
+// unless the minute has changed since the previous call. buf must have room for IOTC_TIMESTAMP_LEN + 1 characters.
+void iotc_timestamp_format(uint64_t time_ms, char *buf);
+
+static inline void iotc_timestamp_now(char *buf) {
+    iotc_timestamp_format(iotc_timestamp_now_ms(), buf);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_TIMESTAMP_H
@@ -0,0 +1,32 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_CERT_STORE_H
+#define IOTC_CERT_STORE_H
+
+#include <stddef.h>
+
+#include "mbedtls/x509_crt.h"
+#include "iotconnect_certs_der.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Registers an additional CA certificate in DER format and returns its ID, or -1 on error. IDs are never IOTC_CERT_NONE.
+// The certificate is parsed without copying, so der must stay valid for the lifetime of the application.
+int iotc_cert_store_register(const unsigned char *der, size_t der_len);
+
+// Returns the certificate parsed on first use and shared by all connections, or NULL on error.
+// cert_id is an IotcCertId or an ID returned by iotc_cert_store_register().
+const mbedtls_x509_crt *iotc_cert_store_get(int cert_id);
+
+// Returns the DER encoded certificate.
+int iotc_cert_store_get_der(int cert_id, const unsigned char **der, size_t *der_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTC_CERT_STORE_H
@@ -7,19 +7,58 @@
 #define IOTC_DEVICE_CLIENT_H
 
 #include "stdbool.h"
+#include <stdint.h>
 #include "iotconnect_discovery.h"
+#include "iotconnect_histogram.h"
 
 #ifdef __cplusplus
 extern   "C" {
 #endif
 
 
+typedef enum {
+    IOTC_QOS0 = 0, // sent once without an acknowledgement. The publish completes as soon as it is written to the socket.
+    IOTC_QOS1 = 1 // acknowledged by the broker with a PUBACK
+} IotConnectQos;
+
+// Outbound messages wait for an in-flight slot in the queue of their class. Control messages are always sent first,
+// and live and backlog messages share the rest by IOTC_DEVICE_CLIENT_LIVE_WEIGHT to one.
+typedef enum {
+    IOTC_TRAFFIC_CONTROL = 0, // command and OTA acks. Used by the functions that wait for the publish.
+    IOTC_TRAFFIC_LIVE, // current telemetry. Used by the async functions.
+    IOTC_TRAFFIC_BACKLOG, // older messages, like the ones replayed from the outbox
+    IOTC_TRAFFIC_CLASS_COUNT
+} IotConnectTrafficClass;
+
+// Called from the SDK's C2D task, so it can take its time and send messages.
+// message is null terminated. It is valid only for the duration of the callback.
 typedef void (*IotConnectC2dCallback)(const char* message, size_t message_len);
 
+// status is EXIT_SUCCESS if the message was acknowledged (or sent, for QoS0), or EXIT_FAILURE otherwise.
+// message is the copy that was published. It is valid only for the duration of the callback.
+typedef void (*IotConnectSendCompleteCallback)(void *user_data, const char *message, size_t message_len, int status);
+
 typedef struct {
     IotConnectC2dCallback c2d_msg_cb; // callback for inbound messages
 } IotConnectDeviceClientConfig;
 
+typedef struct {
+    uint32_t received; // inbound messages received from the MQTT agent
+    uint32_t processed; // messages passed to the C2D callback
+    uint32_t dropped; // messages dropped because the queue was full or the message was too long
+    uint32_t high_water_bytes; // highest queue usage seen, including the per-message overhead
+    uint32_t queue_size; // IOTC_DEVICE_CLIENT_C2D_QUEUE_SIZE
+} IotConnectC2dStats;
+
+typedef struct {
+    uint32_t queued; // messages accepted into the class queue
+    uint32_t sent; // messages handed to the MQTT agent
+    uint32_t rejected; // messages refused because the queue stayed full for IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS
+    uint32_t high_water; // most messages waiting in the queue at the same time
+    uint32_t queue_len; // the configured queue length
+    IotConnectHistogram queue_time_ms; // time spent waiting in the queue
+} IotConnectTrafficStats;
+
 int iotc_device_client_init(IotConnectDeviceClientConfig *c);
 
 // NOTE: Currently not supported
@@ -27,8 +66,39 @@ int iotc_device_client_disconnect();
 
 bool iotc_device_client_is_connected();
 
+// Inbound messages are queued and processed by a separate task. Use these stats to size the queue.
+void iotc_device_client_get_c2d_stats(IotConnectC2dStats *stats);
+
+// Queueing stats of each outbound traffic class, indexed by IotConnectTrafficClass
+void iotc_device_client_get_traffic_stats(IotConnectTrafficStats stats[IOTC_TRAFFIC_CLASS_COUNT]);
+
+// Publishes with QoS1 as IOTC_TRAFFIC_CONTROL and waits for the PUBACK
 int iotc_device_client_send_message(const char *message);
 
+// Same as iotc_device_client_send_message(), with the given QoS. With IOTC_QOS0 it only waits until the message is sent.
+int iotc_device_client_send_message_qos(const char *message, IotConnectQos qos);
+
+// Same as iotc_device_client_send_message_qos(), for messages that are not null terminated, like binary ones
+int iotc_device_client_send_message_len(const char *message, size_t len, IotConnectQos qos);
+
+// Queues the message for publishing as IOTC_TRAFFIC_LIVE without waiting for the PUBACK.
+// The message is copied, so the caller can free or reuse it as soon as this function returns.
+// If this function returns EXIT_SUCCESS, cb (optional) will be called from the MQTT agent task once the publish completes.
+// The callback must not block or send messages, as the agent cannot process any other commands while it runs.
+// Up to IOTC_DEVICE_CLIENT_MAX_INFLIGHT messages can be unacknowledged at the same time.
+// When that limit is reached, messages wait in the queue of their class. If that queue is full,
+// this function blocks until there is room or IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS passes.
+int iotc_device_client_send_message_async(const char *message, IotConnectSendCompleteCallback cb, void *user_data);
+
+// Same as iotc_device_client_send_message_async(), with the given QoS. The async functions publish with QoS1 by default.
+int iotc_device_client_send_message_async_qos(const char *message, IotConnectQos qos, IotConnectSendCompleteCallback cb, void *user_data);
+
+// Same as iotc_device_client_send_message_async_qos(), in the given traffic class
+int iotc_device_client_send_message_class(const char *message, IotConnectQos qos, IotConnectTrafficClass cls, IotConnectSendCompleteCallback cb, void *user_data);
+
+// Same as iotc_device_client_send_message_class(), for messages that are not null terminated
+int iotc_device_client_send_message_class_len(const char *message, size_t len, IotConnectQos qos, IotConnectTrafficClass cls, IotConnectSendCompleteCallback cb, void *user_data);
+
 #ifdef __cplusplus
 }
 #endif
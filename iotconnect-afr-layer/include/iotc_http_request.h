@@ -9,20 +9,56 @@
 extern   "C" {
 #endif
 
+#include <stdint.h>
 #include <stdlib.h>
 
+// Receives the next chunk of a response body. Return non-zero to abort the request.
+typedef int (*IotConnectHttpBodyCallback)(void* user_data, const char* data, size_t len);
+
 typedef struct IotConnectHttpRequest {
     char* host_name;
     char* resource; // path of the resource to GET/PUT
     char* payload; // if payload is not null, a POST will be issued, rather than GET.
-    char* response; // We will will provide a default buffer with default size. Response will be a null terminated string.
-    char* tls_cert; // provide an SSL certificate for your host (default ones provided in iotconnect_certs.h)
+    char* response; // We will will provide a buffer from the client pool. Response will be a null terminated string. Must be released with iotconnect_https_release_response().
+    int tls_cert; // CA certificate ID of your host. An IotcCertId or an ID returned by iotc_cert_store_register(). Required.
+    // If set, the body of a successful response is passed to body_cb in chunks as it is received
+    // and response is left NULL, so the body size is not limited by the client buffer.
+    // A request is not retried once a part of the body was passed to body_cb.
+    IotConnectHttpBodyCallback body_cb;
+    void* user_data; // passed to body_cb
+    void* context; // private. Holds the response buffer until it is released.
 } IotConnectHttpRequest;
 
+typedef struct IotConnectHttpStats {
+    uint32_t requests; // completed requests, including failed ones
+    uint32_t handshakes; // new TLS connections
+    uint32_t resumed_handshakes; // new TLS connections that resumed a saved session. The rest were full handshakes.
+    uint32_t reused; // requests that were sent over an idle connection kept from an earlier request
+    uint32_t last_request_ms; // duration of the last request, including the connection setup
+    uint32_t total_request_ms;
+} IotConnectHttpStats;
+
 // supports get and post
 // if post_data is NULL, a get is executed
+// Connections are kept open for IOTC_HTTP_CLIENT_KEEP_ALIVE_MS after a request
+// and reused by the next request to the same host.
+// Up to IOTC_HTTP_CLIENT_POOL_SIZE requests can run at the same time from different tasks.
+// The response and context fields are cleared on entry, so release the response of an earlier request
+// with iotconnect_https_release_response() before the request is reused.
 int iotconnect_https_request(IotConnectHttpRequest* request);
 
+// Returns the buffer that holds request->response to the client pool. Must be called after a successful
+// request without a body_cb once the response is no longer needed.
+// IMPORTANT: The pool only has IOTC_HTTP_CLIENT_POOL_SIZE buffers (2 by default). Each response that is not released
+// holds one of them for good, and once they are all held, every HTTPS request in the application, including the SDK's
+// discovery and sync, fails after waiting IOTC_HTTP_CLIENT_POOL_WAIT_MS. request->response is NULL after a failed request.
+void iotconnect_https_release_response(IotConnectHttpRequest* request);
+
+void iotconnect_https_get_stats(IotConnectHttpStats* stats);
+
+// Closes the connections that are kept open for reuse. Call when no more requests are expected for a while.
+void iotconnect_https_close_idle_connections(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,27 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_STORAGE_LFS_H
+#define IOTC_STORAGE_LFS_H
+
+#include "lfs.h"
+#include "iotconnect_storage.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Storage backed by a file on the on-board flash littlefs partition.
+// Pass pxGetDefaultFsCtx() as lfs to use the default file system of the reference project.
+// A write rewrites the file from the written block to the end, so keep small state that changes often,
+// like the outbox header, in a file of its own. A file that small is stored in the directory metadata.
+int iotc_storage_lfs_open(IotConnectStorage *storage, lfs_t *lfs, const char *path, size_t size);
+
+void iotc_storage_lfs_close(IotConnectStorage *storage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTC_STORAGE_LFS_H
@@ -0,0 +1,136 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "iotc_cert_store.h"
+
+// Number of certificates that can be added with iotc_cert_store_register()
+#ifndef IOTC_CERT_STORE_MAX_EXTRA
+#define IOTC_CERT_STORE_MAX_EXTRA    ( 2 )
+#endif
+
+#define CERT_STORE_SIZE    ( IOTC_CERT_BUILTIN_COUNT + IOTC_CERT_STORE_MAX_EXTRA )
+
+typedef struct {
+    IotcDerCert xDer;
+    bool xParsed;
+    mbedtls_x509_crt xCrt;
+} CertStoreEntry_t;
+
+static CertStoreEntry_t xCertStore[CERT_STORE_SIZE]; // indexed by the certificate ID - 1. IOTC_CERT_NONE has no entry.
+static int xNumExtraCerts = 0;
+static StaticSemaphore_t xCertStoreLockStorage;
+static SemaphoreHandle_t xCertStoreLock = NULL;
+
+static void prvLock(void)
+{
+    if (NULL == xCertStoreLock) {
+        taskENTER_CRITICAL();
+        if (NULL == xCertStoreLock) {
+            xCertStoreLock = xSemaphoreCreateMutexStatic(&xCertStoreLockStorage);
+        }
+        taskEXIT_CRITICAL();
+    }
+    ( void ) xSemaphoreTake(xCertStoreLock, portMAX_DELAY);
+}
+
+static void prvUnlock(void)
+{
+    ( void ) xSemaphoreGive(xCertStoreLock);
+}
+
+static const IotcDerCert* prvGetDer(int cert_id)
+{
+    if (cert_id <= IOTC_CERT_NONE || cert_id > IOTC_CERT_BUILTIN_COUNT + xNumExtraCerts) {
+        return NULL;
+    }
+    if (cert_id <= IOTC_CERT_BUILTIN_COUNT) {
+        return &iotc_builtin_certs[cert_id - 1];
+    }
+    return &xCertStore[cert_id - 1].xDer;
+}
+
+int iotc_cert_store_register(const unsigned char *der, size_t der_len)
+{
+    int cert_id = -1;
+
+    if (!der || !der_len) {
+        return -1;
+    }
+
+    prvLock();
+    // the same certificate may be registered by several components
+    for (int i = 1; i <= IOTC_CERT_BUILTIN_COUNT + xNumExtraCerts; i++) {
+        const IotcDerCert* pxDer = prvGetDer(i);
+        if (pxDer->der_len == der_len && 0 == memcmp(pxDer->der, der, der_len)) {
+            cert_id = i;
+            break;
+        }
+    }
+    if (cert_id < 0 && xNumExtraCerts < IOTC_CERT_STORE_MAX_EXTRA) {
+        xCertStore[IOTC_CERT_BUILTIN_COUNT + xNumExtraCerts].xDer.der = der;
+        xCertStore[IOTC_CERT_BUILTIN_COUNT + xNumExtraCerts].xDer.der_len = der_len;
+        xNumExtraCerts++;
+        cert_id = IOTC_CERT_BUILTIN_COUNT + xNumExtraCerts;
+    }
+    prvUnlock();
+
+    if (cert_id < 0) {
+        LogError(("Certificate store is full. Increase IOTC_CERT_STORE_MAX_EXTRA."));
+    }
+    return cert_id;
+}
+
+const mbedtls_x509_crt *iotc_cert_store_get(int cert_id)
+{
+    const mbedtls_x509_crt* pxCrt = NULL;
+    const IotcDerCert* pxDer;
+
+    prvLock();
+    pxDer = prvGetDer(cert_id);
+    if (pxDer) {
+        CertStoreEntry_t* pxEntry = &xCertStore[cert_id - 1];
+        if (!pxEntry->xParsed) {
+            mbedtls_x509_crt_init(&pxEntry->xCrt);
+            // the DER blobs are constant, so there is no need to copy them to the heap
+            int lError = mbedtls_x509_crt_parse_der_nocopy(&pxEntry->xCrt, pxDer->der, pxDer->der_len);
+            if (lError) {
+                LogError(("Failed to parse certificate %d. Error: %d", cert_id, lError));
+                mbedtls_x509_crt_free(&pxEntry->xCrt);
+            } else {
+                pxEntry->xParsed = true;
+            }
+        }
+        if (pxEntry->xParsed) {
+            pxCrt = &pxEntry->xCrt;
+        }
+    }
+    prvUnlock();
+
+    return pxCrt;
+}
+
+int iotc_cert_store_get_der(int cert_id, const unsigned char **der, size_t *der_len)
+{
+    const IotcDerCert* pxDer;
+
+    prvLock();
+    pxDer = prvGetDer(cert_id);
+    prvUnlock();
+
+    if (!pxDer) {
+        return EXIT_FAILURE;
+    }
+    *der = pxDer->der;
+    *der_len = pxDer->der_len;
+    return EXIT_SUCCESS;
+}
@@ -33,6 +33,9 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
+#include "queue.h"
+#include "message_buffer.h"
 
 
 
@@ -41,14 +44,76 @@
 #include "subscription_manager.h"
 #include "mqtt_agent_task.h"
 
+#include "iotconnect_metrics.h"
 #include "iotconnect_sync.h"
 #include "iotc_device_client.h"
 
 #define MQTT_PUBLISH_BLOCK_TIME_MS           ( 200 )
 #define MQTT_NOTIFY_IDX                      ( 1 )
 #define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
-#define MQTT_PUBLISH_QOS                     ( MQTTQoS1 )
+#define MQTT_PUBLISH_QOS                     ( IOTC_QOS1 ) // for the functions that do not take the QoS
 
+// Maximum number of asynchronous publishes that can be waiting for completion (PUBACK for QoS1) at the same time.
+#ifndef IOTC_DEVICE_CLIENT_MAX_INFLIGHT
+#define IOTC_DEVICE_CLIENT_MAX_INFLIGHT      ( 4 )
+#endif
+
+// How long the send functions will wait for room in the queue of the message's traffic class before giving up.
+#ifndef IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS
+#define IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS  ( 5000 )
+#endif
+
+// Number of messages of each traffic class that can wait for an in-flight slot
+#ifndef IOTC_DEVICE_CLIENT_CONTROL_QUEUE_LEN
+#define IOTC_DEVICE_CLIENT_CONTROL_QUEUE_LEN ( 4 )
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_LIVE_QUEUE_LEN
+#define IOTC_DEVICE_CLIENT_LIVE_QUEUE_LEN    ( 8 )
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_BACKLOG_QUEUE_LEN
+#define IOTC_DEVICE_CLIENT_BACKLOG_QUEUE_LEN ( 4 )
+#endif
+
+// Live messages sent for each backlog message while both are waiting.
+// 0 gives live messages strict priority, so the backlog is sent only when there is no live traffic.
+#ifndef IOTC_DEVICE_CLIENT_LIVE_WEIGHT
+#define IOTC_DEVICE_CLIENT_LIVE_WEIGHT       ( 4 )
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_SCHEDULER_STACK_SIZE
+#define IOTC_DEVICE_CLIENT_SCHEDULER_STACK_SIZE ( 2048 )
+#endif
+
+// Above the C2D task, so that acks sent by command handlers are not held up by inbound traffic
+#ifndef IOTC_DEVICE_CLIENT_SCHEDULER_PRIORITY
+#define IOTC_DEVICE_CLIENT_SCHEDULER_PRIORITY   ( tskIDLE_PRIORITY + 3 )
+#endif
+
+// Size in bytes of the queue that holds inbound messages between the MQTT agent task and the C2D task.
+// Each queued message takes its length plus sizeof(size_t).
+#ifndef IOTC_DEVICE_CLIENT_C2D_QUEUE_SIZE
+#define IOTC_DEVICE_CLIENT_C2D_QUEUE_SIZE    ( 4096 )
+#endif
+
+// Longer inbound messages are dropped
+#ifndef IOTC_DEVICE_CLIENT_C2D_MAX_MESSAGE_SIZE
+#define IOTC_DEVICE_CLIENT_C2D_MAX_MESSAGE_SIZE    ( 2048 )
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_C2D_TASK_STACK_SIZE
+#define IOTC_DEVICE_CLIENT_C2D_TASK_STACK_SIZE    ( 4096 )
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_C2D_TASK_PRIORITY
+#define IOTC_DEVICE_CLIENT_C2D_TASK_PRIORITY    ( tskIDLE_PRIORITY + 2 )
+#endif
+
+// How often the C2D task checks for a reconnect of the MQTT agent while there are no inbound messages
+#ifndef IOTC_DEVICE_CLIENT_RECONNECT_CHECK_MS
+#define IOTC_DEVICE_CLIENT_RECONNECT_CHECK_MS    ( 500 )
+#endif
 
 /*-----------------------------------------------------------*/
 typedef struct MQTTAgentCommandContext
@@ -61,11 +126,87 @@ typedef struct MQTTAgentCommandContext
     MQTTAgentHandle_t xAgentHandle;
 } ShadowDeviceCtx_t;
 
-
+/**
+ * @brief State of an asynchronous publish that was handed to the MQTT agent.
+ * The agent holds on to the publish info and the payload until the command completes,
+ * so both must live here rather than on the caller's stack.
+ */
+typedef struct {
+    bool in_use;
+    char *payload;
+    const IotConnectSyncProfile *profile; // holds the topic until the publish completes
+    uint32_t started; // when the publish was handed to the MQTT agent
+    MQTTPublishInfo_t publish_info;
+    IotConnectSendCompleteCallback cb;
+    void *user_data;
+} InflightPublish_t;
+
+/**
+ * @brief A message waiting in the queue of its traffic class for an in-flight slot.
+ */
+typedef struct {
+    char *payload; // the sender's copy, freed once the publish completes
+    size_t len;
+    IotConnectQos qos;
+    IotConnectSendCompleteCallback cb;
+    void *user_data;
+    TickType_t queued_at;
+} OutboundMessage_t;
+
+/**
+ * @brief A send that a task waits for in iotc_device_client_send_message_len().
+ * If the task times out, the message is still queued, so the completion callback frees this instead.
+ */
+typedef struct {
+    TaskHandle_t task;
+    int status;
+    bool done;
+    bool abandoned;
+} SyncSend_t;
+
+static InflightPublish_t inflight_slots[IOTC_DEVICE_CLIENT_MAX_INFLIGHT];
+static StaticSemaphore_t inflight_sem_storage;
+static SemaphoreHandle_t inflight_sem = NULL;
+
+// Outbound messages are queued by traffic class, and the scheduler task publishes them
+// in priority order as in-flight slots free up, so that acks do not wait behind a telemetry backlog.
+static const UBaseType_t class_queue_lengths[IOTC_TRAFFIC_CLASS_COUNT] = {
+    IOTC_DEVICE_CLIENT_CONTROL_QUEUE_LEN,
+    IOTC_DEVICE_CLIENT_LIVE_QUEUE_LEN,
+    IOTC_DEVICE_CLIENT_BACKLOG_QUEUE_LEN
+};
+static uint8_t control_queue_storage[IOTC_DEVICE_CLIENT_CONTROL_QUEUE_LEN * sizeof(OutboundMessage_t)];
+static uint8_t live_queue_storage[IOTC_DEVICE_CLIENT_LIVE_QUEUE_LEN * sizeof(OutboundMessage_t)];
+static uint8_t backlog_queue_storage[IOTC_DEVICE_CLIENT_BACKLOG_QUEUE_LEN * sizeof(OutboundMessage_t)];
+static uint8_t * const class_queue_storage[IOTC_TRAFFIC_CLASS_COUNT] = {
+    control_queue_storage,
+    live_queue_storage,
+    backlog_queue_storage
+};
+static StaticQueue_t class_queue_structs[IOTC_TRAFFIC_CLASS_COUNT];
+static QueueHandle_t class_queues[IOTC_TRAFFIC_CLASS_COUNT];
+static StaticSemaphore_t outbound_pending_storage;
+static SemaphoreHandle_t outbound_pending = NULL; // counts the messages in all class queues
+static IotConnectTrafficStats class_stats[IOTC_TRAFFIC_CLASS_COUNT];
+
+
+// Inbound messages are queued by the MQTT agent task and processed by the C2D task,
+// so that slow command handlers do not hold up the MQTT connection.
+// The message buffer has a single writer and a single reader, so it needs no locking.
+static uint8_t c2d_queue_storage[IOTC_DEVICE_CLIENT_C2D_QUEUE_SIZE + 1]; // message buffers need one extra byte
+static StaticMessageBuffer_t c2d_queue_struct;
+static MessageBufferHandle_t c2d_queue = NULL;
+static char c2d_message[IOTC_DEVICE_CLIENT_C2D_MAX_MESSAGE_SIZE + 1]; // C2D task's copy, with room for a null terminator
+static IotConnectC2dStats c2d_stats;
+
+// Broker settings of the current MQTT connection. The topics stay the same until the agent reconnects,
+// even if a re-sync swaps in a new profile. Swapped only by init and the C2D task, in a critical section.
+static const IotConnectSyncProfile *connection_profile = NULL;
 static IotConnectC2dCallback c2d_msg_cb = NULL; // callback for inbound messages
 static MQTTAgentHandle_t xAgentHandle = NULL;
 static bool is_initialized = false;
 
+// Runs in the MQTT agent task. Must not block.
 static void devicebound_event_callback( void * pvCtx, MQTTPublishInfo_t * pxPublishInfo ) {
 
 	(void)pvCtx;
@@ -73,137 +214,375 @@ static void devicebound_event_callback( void * pvCtx, MQTTPublishInfo_t * pxPubl
     configASSERT( pxPublishInfo != NULL );
     configASSERT( pxPublishInfo->pPayload != NULL );
 
-    LogInfo( "Inbound message:%.*s.",
-              pxPublishInfo->payloadLength,
-              ( const char * ) pxPublishInfo->pPayload );
+    LogDebug( "Inbound message of %lu bytes.", ( unsigned long ) pxPublishInfo->payloadLength );
 
-    if (c2d_msg_cb) {
-    	c2d_msg_cb(( const char * ) pxPublishInfo->pPayload, pxPublishInfo->payloadLength);
+    c2d_stats.received++;
+    if (pxPublishInfo->payloadLength > IOTC_DEVICE_CLIENT_C2D_MAX_MESSAGE_SIZE
+        || xMessageBufferSend(c2d_queue, pxPublishInfo->pPayload, pxPublishInfo->payloadLength, 0) == 0) {
+        c2d_stats.dropped++;
+        LogError( "Dropped an inbound message of %lu bytes. Dropped so far: %lu.",
+                  ( unsigned long ) pxPublishInfo->payloadLength, ( unsigned long ) c2d_stats.dropped );
+        return;
     }
 
+    size_t used = IOTC_DEVICE_CLIENT_C2D_QUEUE_SIZE - xMessageBufferSpacesAvailable(c2d_queue);
+    if (used > c2d_stats.high_water_bytes) {
+        c2d_stats.high_water_bytes = ( uint32_t ) used;
+    }
 }
 
-static bool subscribe_to_devicebound_topic() {
+static void prvCheckReconnect(void);
+
+static void c2d_task(void * pvParameters) {
+    (void) pvParameters;
+
+    for (;;) {
+        size_t len = xMessageBufferReceive(c2d_queue, c2d_message, IOTC_DEVICE_CLIENT_C2D_MAX_MESSAGE_SIZE,
+                                           pdMS_TO_TICKS(IOTC_DEVICE_CLIENT_RECONNECT_CHECK_MS));
+        // before the message, so that the subscriptions are settled as soon as possible after a reconnect
+        prvCheckReconnect();
+        if (len == 0) {
+            continue;
+        }
+        c2d_message[len] = 0;
+        c2d_stats.processed++;
+        if (c2d_msg_cb) {
+            uint32_t start = iotc_metrics_start();
+            c2d_msg_cb(c2d_message, len);
+            iotc_metrics_end(IOTC_METRIC_C2D, start, true);
+        }
+    }
+}
+
+static bool subscribe_to_devicebound_topic(const IotConnectSyncProfile *profile) {
     MQTTStatus_t xStatus = MQTTSuccess;
 
     xStatus = MqttAgent_SubscribeSync( xAgentHandle,
-                                       iotc_sync_get_sub_topic(),
+                                       profile->sub_topic,
                                        MQTTQoS1,
                                        devicebound_event_callback,
                                        NULL );
 
     if( xStatus != MQTTSuccess )
     {
-        LogError( "Failed to subscribe to topic: %s", iotc_sync_get_sub_topic());
+        LogError( "Failed to subscribe to topic: %s", profile->sub_topic);
         return pdFALSE;
     }
 
     return pdTRUE;
 }
 
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-	MQTTAgentReturnInfo_t * pxReturnInfo
-	)
-{
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
+// Returns a reference to the profile of the current connection, or NULL if there is none
+static const IotConnectSyncProfile *prvRetainConnectionProfile(void) {
+    const IotConnectSyncProfile *profile;
 
-    configASSERT( pxReturnInfo != NULL );
+    taskENTER_CRITICAL();
+    profile = iotc_sync_retain_profile(connection_profile);
+    taskEXIT_CRITICAL();
+    return profile;
+}
 
-    uint32_t ulNotifyValue = pxReturnInfo->returnCode;
+// Takes over the reference to the profile, and drops the one to the previous profile
+static void prvSetConnectionProfile(const IotConnectSyncProfile *profile) {
+    const IotConnectSyncProfile *old;
 
-    if( xTaskHandle != NULL )
-    {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
+    taskENTER_CRITICAL();
+    old = connection_profile;
+    connection_profile = profile;
+    taskEXIT_CRITICAL();
+    iotc_sync_release_profile(old);
+}
+
+// Runs in the C2D task once the agent has reconnected, with the settings of the current profile.
+// The devicebound subscription moves to the new topic if it changed.
+static void prvOnReconnect(void) {
+    const IotConnectSyncProfile *profile = iotc_sync_acquire_profile();
+    const IotConnectSyncProfile *old = prvRetainConnectionProfile();
+
+    if (NULL == profile || profile == old) {
+        iotc_sync_release_profile(profile);
+        iotc_sync_release_profile(old);
+        return;
     }
+    if (NULL == old || 0 != strcmp(old->sub_topic, profile->sub_topic)) {
+        if (!subscribe_to_devicebound_topic(profile)) {
+            iotc_sync_release_profile(profile); // keep the old topics, which the broker may still accept
+            iotc_sync_release_profile(old);
+            return;
+        }
+        if (old) {
+            ( void ) MqttAgent_UnSubscribeSync( xAgentHandle, old->sub_topic, devicebound_event_callback, NULL );
+        }
+    }
+    LogInfo( "Switched to the topics of sync profile %lu.", ( unsigned long ) profile->version );
+    iotc_sync_release_profile(old);
+    prvSetConnectionProfile(profile);
 }
 
+// Notices the reconnects from the C2D task, rather than from the publish path, so that the devicebound
+// subscription is restored even if nothing is sent, and the blocking subscribe does not hold an in-flight slot.
+static void prvCheckReconnect(void) {
+    static bool was_connected = true; // only used by the C2D task
+    bool connected = xIsMqttAgentConnected();
+
+    if (NULL == connection_profile) {
+        return; // init has not subscribed yet
+    }
+
+    if (connected && !was_connected) {
+        prvOnReconnect();
+    }
+    was_connected = connected;
+}
+
+static InflightPublish_t *prvAcquireInflightSlot(void) {
+    InflightPublish_t *slot = NULL;
+
+    // only the scheduler task acquires slots, so it can wait as long as it takes
+    ( void ) xSemaphoreTake(inflight_sem, portMAX_DELAY);
+
+    taskENTER_CRITICAL();
+    for (int i = 0; i < IOTC_DEVICE_CLIENT_MAX_INFLIGHT; i++) {
+        if (!inflight_slots[i].in_use) {
+            slot = &inflight_slots[i];
+            slot->in_use = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    // the semaphore count guarantees that there is a free slot
+    configASSERT(slot != NULL);
+    return slot;
+}
+
+static void prvReleaseInflightSlot(InflightPublish_t *slot) {
+    vPortFree(slot->payload);
+    slot->payload = NULL;
+    iotc_sync_release_profile(slot->profile);
+    slot->profile = NULL;
+    slot->cb = NULL;
+    slot->user_data = NULL;
+
+    taskENTER_CRITICAL();
+    slot->in_use = false;
+    taskEXIT_CRITICAL();
 
-static BaseType_t prvPublishAndWaitForAck(const char * pcTopic,
-	const void * pvPublishData,
-	size_t xPublishDataLen
+    ( void ) xSemaphoreGive(inflight_sem);
+}
+
+// Runs in the MQTT agent task context once the PUBACK is received (or QoS0 publish is sent)
+static void prvAsyncPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+	MQTTAgentReturnInfo_t * pxReturnInfo
 	)
 {
-    MQTTStatus_t xStatus;
-    size_t uxTopicLen = 0;
-
-    configASSERT( pcTopic != NULL );
-    configASSERT( pvPublishData != NULL );
-    configASSERT( xPublishDataLen > 0 );
+    InflightPublish_t *slot = ( InflightPublish_t * ) pxCommandContext;
 
-    uxTopicLen = strnlen( pcTopic, UINT16_MAX );
+    configASSERT( pxReturnInfo != NULL );
+    configASSERT( slot != NULL );
 
-    MQTTPublishInfo_t xPublishInfo =
+    if( pxReturnInfo->returnCode != MQTTSuccess )
     {
-        .qos             = MQTT_PUBLISH_QOS,
-        .retain          = 0,
-        .dup             = 0,
-        .pTopicName      = pcTopic,
-        .topicNameLength = ( uint16_t ) uxTopicLen,
-        .pPayload        = pvPublishData,
-        .payloadLength   = xPublishDataLen
-    };
+        LogError( "MQTT Agent returned error code: %d during async publish operation.",
+                  pxReturnInfo->returnCode );
+    }
+
+    iotc_metrics_end(IOTC_METRIC_PUBLISH, slot->started, pxReturnInfo->returnCode == MQTTSuccess);
+
+    if (slot->cb) {
+        slot->cb(slot->user_data,
+                 slot->payload,
+                 slot->publish_info.payloadLength,
+                 pxReturnInfo->returnCode == MQTTSuccess ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    prvReleaseInflightSlot(slot);
+}
+
+// Hands the message to the MQTT agent. The slot takes over the payload.
+static void prvPublishFromSlot(InflightPublish_t *slot, OutboundMessage_t *pxMessage) {
+    MQTTStatus_t xStatus;
+    // Never blocks. The connection's profile stays valid until the publish completes, even if a reconnect replaces it.
+    const IotConnectSyncProfile *pxProfile = prvRetainConnectionProfile();
+
+    slot->payload = pxMessage->payload;
+    slot->profile = pxProfile;
+    slot->cb = pxMessage->cb;
+    slot->user_data = pxMessage->user_data;
+
+    slot->publish_info.qos = ( pxMessage->qos == IOTC_QOS0 ) ? MQTTQoS0 : MQTTQoS1;
+    slot->publish_info.retain = 0;
+    slot->publish_info.dup = 0;
+    slot->publish_info.pTopicName = pxProfile ? pxProfile->pub_topic : NULL;
+    slot->publish_info.topicNameLength = pxProfile ? pxProfile->pub_topic_len : 0;
+    slot->publish_info.pPayload = slot->payload;
+    slot->publish_info.payloadLength = pxMessage->len;
 
     MQTTAgentCommandInfo_t xCommandParams =
     {
         .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
-        .cmdCompleteCallback         = prvPublishCommandCallback,
-        .pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle(),
+        .cmdCompleteCallback         = prvAsyncPublishCommandCallback,
+        .pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) slot,
     };
 
-    if( xPublishInfo.qos > MQTTQoS0 )
+    slot->started = iotc_metrics_start();
+    xStatus = pxProfile ? MQTTAgent_Publish( xAgentHandle, &slot->publish_info, &xCommandParams ) : MQTTBadParameter;
+
+    if( xStatus != MQTTSuccess )
     {
-        xCommandParams.pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle();
+        // the command was never queued, so the agent will not call back. The sender was already told
+        // that the message is queued, so it gets the failure through its callback.
+        LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+        if (slot->cb) {
+            slot->cb(slot->user_data, slot->payload, pxMessage->len, EXIT_FAILURE);
+        }
+        prvReleaseInflightSlot(slot);
     }
+}
 
-    /* Clear the notification index */
-    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
-
+// Control messages always go first. Live and backlog messages share what is left
+// by IOTC_DEVICE_CLIENT_LIVE_WEIGHT to one while both are waiting.
+static IotConnectTrafficClass prvPickClass(void) {
+    static unsigned int live_streak = 0; // only used by the scheduler task
+    bool live_waiting;
+    bool backlog_waiting;
 
-    xStatus = MQTTAgent_Publish( xAgentHandle,
-                                 &xPublishInfo,
-                                 &xCommandParams );
+    if (uxQueueMessagesWaiting(class_queues[IOTC_TRAFFIC_CONTROL]) > 0) {
+        return IOTC_TRAFFIC_CONTROL;
+    }
 
-    if( xStatus == MQTTSuccess )
-    {
-        uint32_t ulNotifyValue = 0;
-        BaseType_t xResult = pdFALSE;
-
-        xResult = xTaskNotifyWaitIndexed( MQTT_NOTIFY_IDX,
-                                          0xFFFFFFFF,
-                                          0xFFFFFFFF,
-                                          &ulNotifyValue,
-                                          pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-
-        if( xResult )
-        {
-            xStatus = ( MQTTStatus_t ) ulNotifyValue;
-
-            if( xStatus != MQTTSuccess )
-            {
-                LogError( "MQTT Agent returned error code: %d during publish operation.",
-                          xStatus );
-                xResult = pdFALSE;
-            }
+    live_waiting = uxQueueMessagesWaiting(class_queues[IOTC_TRAFFIC_LIVE]) > 0;
+    backlog_waiting = uxQueueMessagesWaiting(class_queues[IOTC_TRAFFIC_BACKLOG]) > 0;
+    if (live_waiting && backlog_waiting) {
+        if (IOTC_DEVICE_CLIENT_LIVE_WEIGHT == 0 || live_streak < IOTC_DEVICE_CLIENT_LIVE_WEIGHT) {
+            live_streak++;
+            return IOTC_TRAFFIC_LIVE;
         }
-        else
-        {
-            LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d",
-                      pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-            xResult = pdFALSE;
+        live_streak = 0;
+        return IOTC_TRAFFIC_BACKLOG;
+    }
+    live_streak = 0;
+    return live_waiting ? IOTC_TRAFFIC_LIVE : IOTC_TRAFFIC_BACKLOG;
+}
+
+static void scheduler_task(void * pvParameters) {
+    OutboundMessage_t xMessage;
+    (void) pvParameters;
+
+    for (;;) {
+        // one count for each queued message
+        ( void ) xSemaphoreTake(outbound_pending, portMAX_DELAY);
+
+        // Wait for a free slot before picking the message, so that a control message
+        // that arrives in the meantime still goes ahead of the ones that were already waiting.
+        InflightPublish_t *slot = prvAcquireInflightSlot();
+        IotConnectTrafficClass cls = prvPickClass();
+
+        if (xQueueReceive(class_queues[cls], &xMessage, 0) != pdTRUE) {
+            // cannot happen while the pending count matches the queues
+            prvReleaseInflightSlot(slot);
+            continue;
         }
+
+        uint32_t waited_ms = ( uint32_t ) ((xTaskGetTickCount() - xMessage.queued_at) * portTICK_PERIOD_MS);
+        taskENTER_CRITICAL();
+        class_stats[cls].sent++;
+        iotc_histogram_add(&class_stats[cls].queue_time_ms, waited_ms);
+        taskEXIT_CRITICAL();
+
+        prvPublishFromSlot(slot, &xMessage);
     }
-    else
-    {
-        LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+}
+
+static BaseType_t prvEnqueue(const char *pcMessage,
+	size_t xMessageLen,
+	IotConnectQos xQos,
+	IotConnectTrafficClass xClass,
+	IotConnectSendCompleteCallback cb,
+	void *user_data
+	)
+{
+    OutboundMessage_t xMessage;
+
+    configASSERT( pcMessage != NULL );
+    configASSERT( xMessageLen > 0 );
+
+    if (NULL == outbound_pending || xClass >= IOTC_TRAFFIC_CLASS_COUNT) {
+        LogError( "Client is not initialized or the traffic class is invalid." );
+        return pdFALSE;
+    }
+
+    xMessage.payload = pvPortMalloc(xMessageLen);
+    if (NULL == xMessage.payload) {
+        LogError( "Failed to allocate %lu bytes for an outbound message.", ( unsigned long ) xMessageLen );
+        return pdFALSE;
+    }
+    memcpy(xMessage.payload, pcMessage, xMessageLen);
+    xMessage.len = xMessageLen;
+    xMessage.qos = xQos;
+    xMessage.cb = cb;
+    xMessage.user_data = user_data;
+    xMessage.queued_at = xTaskGetTickCount();
+
+    if (xQueueSend(class_queues[xClass], &xMessage, pdMS_TO_TICKS(IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS)) != pdTRUE) {
+        vPortFree(xMessage.payload);
+        taskENTER_CRITICAL();
+        class_stats[xClass].rejected++;
+        taskEXIT_CRITICAL();
+        LogError( "Timed out while waiting for room in the queue of traffic class %d. xTimeout = %d",
+                  ( int ) xClass, pdMS_TO_TICKS( IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS ) );
+        return pdFALSE;
+    }
+
+    uint32_t waiting = ( uint32_t ) uxQueueMessagesWaiting(class_queues[xClass]);
+    taskENTER_CRITICAL();
+    class_stats[xClass].queued++;
+    if (waiting > class_stats[xClass].high_water) {
+        class_stats[xClass].high_water = waiting;
+    }
+    taskEXIT_CRITICAL();
+
+    ( void ) xSemaphoreGive(outbound_pending);
+    return pdTRUE;
+}
+
+// Runs in the MQTT agent task and wakes up the task that is waiting in iotc_device_client_send_message_len().
+// The completion of a send that the task gave up on is dropped, so that it is not taken for the result of a later send.
+static void prvSyncSendComplete(void *user_data, const char *message, size_t message_len, int status) {
+    SyncSend_t *pxSend = ( SyncSend_t * ) user_data;
+    TaskHandle_t xTask;
+    bool abandoned;
+    (void) message;
+    (void) message_len;
+
+    taskENTER_CRITICAL();
+    xTask = pxSend->task; // the waiting task may free pxSend as soon as done is set
+    abandoned = pxSend->abandoned;
+    pxSend->status = status;
+    pxSend->done = true;
+    taskEXIT_CRITICAL();
+
+    if (abandoned) {
+        vPortFree(pxSend);
+        return;
     }
+    ( void ) xTaskNotifyGiveIndexed( xTask, MQTT_NOTIFY_IDX );
+}
+
+void iotc_device_client_get_c2d_stats(IotConnectC2dStats *stats) {
+    taskENTER_CRITICAL();
+    *stats = c2d_stats;
+    taskEXIT_CRITICAL();
+    stats->queue_size = IOTC_DEVICE_CLIENT_C2D_QUEUE_SIZE;
+}
 
-    return( xStatus == MQTTSuccess );
+void iotc_device_client_get_traffic_stats(IotConnectTrafficStats stats[IOTC_TRAFFIC_CLASS_COUNT]) {
+    taskENTER_CRITICAL();
+    memcpy(stats, class_stats, sizeof(class_stats));
+    taskEXIT_CRITICAL();
+    for (int i = 0; i < IOTC_TRAFFIC_CLASS_COUNT; i++) {
+        stats[i].queue_len = class_queue_lengths[i];
+    }
 }
 
 int iotc_device_client_disconnect() {
@@ -215,22 +594,89 @@ bool iotc_device_client_is_connected() {
     return xIsMqttAgentConnected();
 }
 
-int iotc_device_client_send_message(const char* message) {
-    BaseType_t xResult = pdFALSE;
+int iotc_device_client_send_message_len(const char* message, size_t len, IotConnectQos qos) {
+    const TickType_t xWait = pdMS_TO_TICKS( IOTC_DEVICE_CLIENT_INFLIGHT_WAIT_MS + MQTT_PUBLISH_NOTIFICATION_WAIT_MS );
+    TickType_t xStart;
+    SyncSend_t *pxSend;
+    bool done;
+    int status;
+
+    pxSend = pvPortMalloc(sizeof(SyncSend_t));
+    if (NULL == pxSend) {
+        LogError( "Failed to allocate the state of a send." );
+        return EXIT_FAILURE;
+    }
+    pxSend->task = xTaskGetCurrentTaskHandle();
+    pxSend->status = EXIT_FAILURE;
+    pxSend->done = false;
+    pxSend->abandoned = false;
 
-    xResult = prvPublishAndWaitForAck(
-	   iotc_sync_get_pub_topic(),
-	   message,
-	   ( size_t ) strlen(message)
-	   );
+    /* Clear the notification index */
+    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
 
-    if( xResult != pdPASS )
-    {
-        LogError( "Failed to publish message %s", message);
+    if (!prvEnqueue(message, len, qos, IOTC_TRAFFIC_CONTROL, prvSyncSendComplete, pxSend)) {
+        vPortFree(pxSend);
+        LogError( "Failed to publish a message of %lu bytes", ( unsigned long ) len);
+        return EXIT_FAILURE;
     }
 
+    // The message may wait for an in-flight slot before it is published.
+    // A notification left over from an earlier send only makes this check again.
+    xStart = xTaskGetTickCount();
+    for (;;) {
+        TickType_t xElapsed = xTaskGetTickCount() - xStart;
+        taskENTER_CRITICAL();
+        done = pxSend->done;
+        status = pxSend->status;
+        if (!done && xElapsed >= xWait) {
+            pxSend->abandoned = true; // the completion callback frees it
+        }
+        taskEXIT_CRITICAL();
+        if (done || xElapsed >= xWait) {
+            break;
+        }
+        ( void ) xTaskNotifyWaitIndexed( MQTT_NOTIFY_IDX, 0, 0xFFFFFFFF, NULL, xWait - xElapsed );
+    }
+
+    if (!done) {
+        LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d", xWait );
+        return EXIT_FAILURE;
+    }
+    vPortFree(pxSend);
 
-    return (xResult == pdPASS ? EXIT_SUCCESS : EXIT_FAILURE);
+    if (status != EXIT_SUCCESS) {
+        LogError( "Failed to publish a message of %lu bytes", ( unsigned long ) len);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotc_device_client_send_message_qos(const char* message, IotConnectQos qos) {
+    return iotc_device_client_send_message_len(message, strlen(message), qos);
+}
+
+int iotc_device_client_send_message(const char* message) {
+    return iotc_device_client_send_message_qos(message, MQTT_PUBLISH_QOS);
+}
+
+int iotc_device_client_send_message_class_len(const char* message, size_t len, IotConnectQos qos, IotConnectTrafficClass cls, IotConnectSendCompleteCallback cb, void *user_data) {
+    if (!prvEnqueue(message, len, qos, cls, cb, user_data)) {
+        LogError( "Failed to queue a message of %lu bytes", ( unsigned long ) len);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotc_device_client_send_message_class(const char* message, IotConnectQos qos, IotConnectTrafficClass cls, IotConnectSendCompleteCallback cb, void *user_data) {
+    return iotc_device_client_send_message_class_len(message, strlen(message), qos, cls, cb, user_data);
+}
+
+int iotc_device_client_send_message_async_qos(const char* message, IotConnectQos qos, IotConnectSendCompleteCallback cb, void *user_data) {
+    return iotc_device_client_send_message_class(message, qos, IOTC_TRAFFIC_LIVE, cb, user_data);
+}
+
+int iotc_device_client_send_message_async(const char* message, IotConnectSendCompleteCallback cb, void *user_data) {
+    return iotc_device_client_send_message_async_qos(message, MQTT_PUBLISH_QOS, cb, user_data);
 }
 
 #if 0
@@ -258,15 +704,52 @@ int iotc_device_client_init(IotConnectDeviceClientConfig* c) {
     }
     is_initialized = true;
 
+    if (NULL == inflight_sem) {
+        inflight_sem = xSemaphoreCreateCountingStatic(IOTC_DEVICE_CLIENT_MAX_INFLIGHT,
+                                                      IOTC_DEVICE_CLIENT_MAX_INFLIGHT,
+                                                      &inflight_sem_storage);
+    }
+
+    if (NULL == outbound_pending) {
+        for (int i = 0; i < IOTC_TRAFFIC_CLASS_COUNT; i++) {
+            class_queues[i] = xQueueCreateStatic(class_queue_lengths[i], sizeof(OutboundMessage_t),
+                                                 class_queue_storage[i], &class_queue_structs[i]);
+        }
+        outbound_pending = xSemaphoreCreateCountingStatic(IOTC_DEVICE_CLIENT_CONTROL_QUEUE_LEN
+                                                          + IOTC_DEVICE_CLIENT_LIVE_QUEUE_LEN
+                                                          + IOTC_DEVICE_CLIENT_BACKLOG_QUEUE_LEN,
+                                                          0,
+                                                          &outbound_pending_storage);
+        if (pdPASS != xTaskCreate(scheduler_task, "IoTC-Send", IOTC_DEVICE_CLIENT_SCHEDULER_STACK_SIZE, NULL, IOTC_DEVICE_CLIENT_SCHEDULER_PRIORITY, NULL)) {
+            LogError(("iotc_device_client_init: Failed to create the scheduler task."));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (NULL == c2d_queue) {
+        c2d_queue = xMessageBufferCreateStatic(sizeof(c2d_queue_storage), c2d_queue_storage, &c2d_queue_struct);
+        if (pdPASS != xTaskCreate(c2d_task, "IoTC-C2D", IOTC_DEVICE_CLIENT_C2D_TASK_STACK_SIZE, NULL, IOTC_DEVICE_CLIENT_C2D_TASK_PRIORITY, NULL)) {
+            LogError(("iotc_device_client_init: Failed to create the C2D task."));
+            return EXIT_FAILURE;
+        }
+    }
+
     /* Wait for MqttAgent to be ready. */
     vSleepUntilMQTTAgentReady();
 
     xAgentHandle = xGetMqttAgentHandle();
 
-    if (!subscribe_to_devicebound_topic()) {
+    const IotConnectSyncProfile *profile = iotc_sync_acquire_profile();
+    if (NULL == profile) {
+        LogError( "Failed to subscribe. The sync has not completed." );
+        return EXIT_FAILURE;
+    }
+    if (!subscribe_to_devicebound_topic(profile)) {
+        iotc_sync_release_profile(profile);
 		LogWarn(("iotc_device_client_init: Unable to subscribe to devicebound messages topic."));
         return EXIT_FAILURE;
     }
+    prvSetConnectionProfile(profile);
 
     c2d_msg_cb = c->c2d_msg_cb;
 
@@ -43,16 +43,25 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 #include "event_groups.h"
 
 #include "sys_evt.h"
 #include "mbedtls_transport.h"
 #include "backoff_algorithm.h"
 #include "core_http_client.h"
+#include "http_parser.h"
+#include "mbedtls/ssl.h"
 
-#include "iotconnect_certs.h"
+// mbedtls 3.x marks the session fields as private, and 2.x does not have the macro
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+#include "iotc_cert_store.h"
 
 #include "iotc_http_request.h"
+#include "iotconnect_metrics.h"
 
 /*------------- Demo configurations -------------------------*/
 
@@ -81,34 +90,113 @@
 // The number of milliseconds to backof between HTTP request failures
 #define HTTP_REQUEST_BACKOFF_MS    ( pdMS_TO_TICKS( 2000U ) )
 
+// How long an idle connection is kept open for the next request to the same host. Set to 0 to disable reuse.
+#ifndef IOTC_HTTP_CLIENT_KEEP_ALIVE_MS
+#define IOTC_HTTP_CLIENT_KEEP_ALIVE_MS    ( 10000U )
+#endif
+
+// Maximum number of idle connections kept open, each to a different host
+#ifndef IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS
+#define IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS    ( 2 )
+#endif
+
+// Number of hosts for which TLS sessions are kept for resumption. Set to 0 to disable resumption.
+// Resumption requires the mbedtls_transport_set_session() and mbedtls_transport_get_session()
+// additions to mbedtls_transport.c described in the README.
+#ifndef IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE
+#define IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE    ( 4 )
+#endif
+
+// How long a saved TLS session is offered for resumption. Servers typically expire them within a day.
+#ifndef IOTC_HTTP_CLIENT_TLS_SESSION_LIFETIME_MS
+#define IOTC_HTTP_CLIENT_TLS_SESSION_LIFETIME_MS    ( 60U * 60U * 1000U )
+#endif
+
+// If enabled, the CA certificate is parsed once by the certificate store and shared by all connections.
+// This requires the mbedtls_transport_set_ca_chain() addition to mbedtls_transport.c described in the README.
+// Otherwise the DER certificate is passed to the transport, which parses it for each connection.
+#ifndef IOTC_HTTP_CLIENT_SHARED_CA_CHAIN
+#define IOTC_HTTP_CLIENT_SHARED_CA_CHAIN    ( 1 )
+#endif
+
+// Number of requests that can run at the same time. Each takes IOTC_HTTP_CLIENT_USER_BUFFER_SIZE of RAM.
+#ifndef IOTC_HTTP_CLIENT_POOL_SIZE
+#define IOTC_HTTP_CLIENT_POOL_SIZE    ( 2 )
+#endif
+
+// How long a request waits for another one to finish when all contexts are in use
+#ifndef IOTC_HTTP_CLIENT_POOL_WAIT_MS
+#define IOTC_HTTP_CLIENT_POOL_WAIT_MS    ( 30000U )
+#endif
+
+#define HTTP_HOST_NAME_MAX_LEN    ( 128 )
+
+// Delay between reads while waiting for more of a streamed response
+#define HTTP_STREAM_RECV_POLL_MS    ( 10U )
+
 
 /*-----------------------------------------------------------*/
 
 /**
- * @brief A buffer used in the demo for storing HTTP request headers, and HTTP
- * response headers and body.
+ * @brief Buffers of a request in progress, taken from a fixed pool so that several tasks can make requests at once.
  *
- * @note This demo shows how the same buffer can be re-used for storing the HTTP
- * response after the HTTP request is sent out. However, the user can decide how
- * to use buffers to store HTTP requests and responses.
+ * The buffer holds the request headers and then the response headers and body.
+ * In streaming mode it holds the request headers and then each received chunk.
  */
-static uint8_t httpClientBuffer[IOTC_HTTP_CLIENT_USER_BUFFER_SIZE];
+typedef struct {
+    BaseType_t xInUse;
+    uint8_t ucBuffer[IOTC_HTTP_CLIENT_USER_BUFFER_SIZE];
+    HTTPRequestHeaders_t xRequestHeaders;
+    HTTPRequestInfo_t xRequestInfo;
+    HTTPResponse_t xResponse;
+} HttpClientContext_t;
 
-/**
- * @brief Represents header data that will be sent in an HTTP request.
- */
-static HTTPRequestHeaders_t requestHeaders;
+static HttpClientContext_t xClientContexts[IOTC_HTTP_CLIENT_POOL_SIZE];
+
+// Counts the free client contexts
+static StaticSemaphore_t xContextsAvailableStorage;
+static SemaphoreHandle_t xContextsAvailable = NULL;
+
+// Guards the context pool, the idle connections, the TLS sessions and the stats
+static StaticSemaphore_t xClientLockStorage;
+static SemaphoreHandle_t xClientLock = NULL;
 
 /**
- * @brief Configurations of the initial request headers that are passed to
- * #HTTPClient_InitializeRequestHeaders.
+ * @brief An idle connection that can be reused for the next request to the same host.
  */
-static HTTPRequestInfo_t requestInfo;
+typedef struct {
+    NetworkContext_t* pxNetworkContext;
+    char pcHostName[HTTP_HOST_NAME_MAX_LEN + 1];
+    TickType_t xLastUsed;
+} IdleConnection_t;
+
+static IdleConnection_t xIdleConnections[IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS];
 
+static IotConnectHttpStats xHttpStats;
+
+#if IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE > 0
 /**
- * @brief Represents a response returned from an HTTP server.
+ * @brief A TLS session (session ID or ticket) saved after a handshake with the host.
  */
-static HTTPResponse_t response;
+typedef struct {
+    BaseType_t xValid;
+    char pcHostName[HTTP_HOST_NAME_MAX_LEN + 1];
+    mbedtls_ssl_session xSession;
+    TickType_t xSaved;
+    TickType_t xLastUsed;
+} CachedTlsSession_t;
+
+static CachedTlsSession_t xTlsSessions[IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE];
+
+// Additions to mbedtls_transport.c. See README.
+extern BaseType_t mbedtls_transport_set_session( NetworkContext_t * pxNetworkContext, const mbedtls_ssl_session * pxSession );
+extern BaseType_t mbedtls_transport_get_session( NetworkContext_t * pxNetworkContext, mbedtls_ssl_session * pxSession );
+#endif
+
+#if IOTC_HTTP_CLIENT_SHARED_CA_CHAIN
+// Addition to mbedtls_transport.c. See README.
+extern BaseType_t mbedtls_transport_set_ca_chain( NetworkContext_t * pxNetworkContext, const mbedtls_x509_crt * pxCaChain );
+#endif
 
 typedef BaseType_t(*TransportConnect_t)(NetworkContext_t* pxNetworkContext, IotConnectHttpRequest* request);
 
@@ -170,10 +258,12 @@ static BaseType_t connectToServerWithBackoffRetriesV2(NetworkContext_t* pxNetwor
                                       pdTRUE,
                                       portMAX_DELAY );
 
+        uint32_t ulStart = iotc_metrics_start();
         xTlsStatus = mbedtls_transport_connect( pxNetworkContext,
                                                 r->host_name,
                                                 443,
                                                 0, 0 );
+        iotc_metrics_end( IOTC_METRIC_TLS_CONNECT, ulStart, xTlsStatus == TLS_TRANSPORT_SUCCESS );
 
     	if( xTlsStatus != TLS_TRANSPORT_SUCCESS )
         {
@@ -263,39 +353,49 @@ static BaseType_t prvConnectToServer(NetworkContext_t* pxCtx, IotConnectHttpRequ
 
 #endif
 
-static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterface, IotConnectHttpRequest* r)
+// pxKeepOpen receives whether the connection can be used for another request.
+// If xReused is set, the connection was used before and may have been closed by the server in the meantime.
+// pxClosed receives whether a reused connection turned out to be closed by the server before any part of the response
+// arrived, in which case the request can be sent again on a new connection.
+static BaseType_t prvClientRequest(HttpClientContext_t* pxCtx, const TransportInterface_t* ptransportInterface, IotConnectHttpRequest* r, BaseType_t xReused, BaseType_t* pxKeepOpen, BaseType_t* pxClosed)
 {
     BaseType_t status = pdFAIL;
     HTTPStatus_t httpStatus;
 
+    *pxKeepOpen = pdFALSE;
+    *pxClosed = pdFALSE;
 
-    configASSERT(r->resource != NULL);
 
-    (void)memset(&requestHeaders, 0, sizeof(requestHeaders));
-    (void)memset(&requestInfo, 0, sizeof(requestInfo));
-    (void)memset(&response, 0, sizeof(response));
+    configASSERT(r->resource != NULL);
 
-    requestInfo.pHost = r->host_name;
-    requestInfo.hostLen = strlen(r->host_name);
-    requestInfo.pMethod = r->payload ? HTTP_METHOD_POST : HTTP_METHOD_GET;
-    requestInfo.methodLen = strlen(requestInfo.pMethod);
-    requestInfo.pPath = r->resource;
-    requestInfo.pathLen = strlen(r->resource);
+    (void)memset(&pxCtx->xRequestHeaders, 0, sizeof(pxCtx->xRequestHeaders));
+    (void)memset(&pxCtx->xRequestInfo, 0, sizeof(pxCtx->xRequestInfo));
+    (void)memset(&pxCtx->xResponse, 0, sizeof(pxCtx->xResponse));
+
+    pxCtx->xRequestInfo.pHost = r->host_name;
+    pxCtx->xRequestInfo.hostLen = strlen(r->host_name);
+    pxCtx->xRequestInfo.pMethod = r->payload ? HTTP_METHOD_POST : HTTP_METHOD_GET;
+    pxCtx->xRequestInfo.methodLen = strlen(pxCtx->xRequestInfo.pMethod);
+    pxCtx->xRequestInfo.pPath = r->resource;
+    pxCtx->xRequestInfo.pathLen = strlen(r->resource);
+    if (IOTC_HTTP_CLIENT_KEEP_ALIVE_MS > 0) {
+        pxCtx->xRequestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+    }
 
-    requestHeaders.pBuffer = httpClientBuffer;
-    requestHeaders.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE;
+    pxCtx->xRequestHeaders.pBuffer = pxCtx->ucBuffer;
+    pxCtx->xRequestHeaders.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE;
 
-    response.pBuffer = httpClientBuffer;
-    response.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE;
+    pxCtx->xResponse.pBuffer = pxCtx->ucBuffer;
+    pxCtx->xResponse.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE - 1; // room for the null terminator after the body
 
-    httpStatus = HTTPClient_InitializeRequestHeaders(&requestHeaders, &requestInfo);
+    httpStatus = HTTPClient_InitializeRequestHeaders(&pxCtx->xRequestHeaders, &pxCtx->xRequestInfo);
 
     if (httpStatus != HTTPSuccess) {
         LogError(("Failed to initialize HTTP request headers: Error=%s.",
             HTTPClient_strerror(httpStatus)));
         return pdFAIL;
     }
-    httpStatus = HTTPClient_AddHeader(&requestHeaders, 
+    httpStatus = HTTPClient_AddHeader(&pxCtx->xRequestHeaders, 
         "Content-Type", strlen("Content-Type"),
         "application/json", strlen("application/json")
     );
@@ -303,10 +403,10 @@ static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterfa
     int tries = 0;
     do {
 		httpStatus = HTTPClient_Send(ptransportInterface,
-			&requestHeaders,
+			&pxCtx->xRequestHeaders,
 			(const uint8_t *) r->payload,
 			r->payload ? strlen(r->payload) : 0,
-			&response,
+			&pxCtx->xResponse,
 			0
 		);
 		if (httpStatus != HTTPNoResponse) {
@@ -316,6 +416,11 @@ static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterfa
         tries++;
     } while (tries < 50); // timeout after 200msz * 50 = 10 seconds.
 
+    // A send or receive error before the status line was parsed. A slow response is HTTPNoResponse instead.
+    if (xReused && httpStatus == HTTPNetworkError && pxCtx->xResponse.statusCode == 0) {
+        *pxClosed = pdTRUE;
+        return pdFAIL;
+    }
     if (httpStatus != HTTPSuccess) {
         LogError(("An error occurred in downloading the file. Failed to send HTTP GET request to %s%s: Error=%s.",
             r->host_name, r->resource, HTTPClient_strerror(httpStatus)));
@@ -323,36 +428,501 @@ static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterfa
     }
 
     LogDebug(("Received HTTP response from %s%s...", host, path));
-    LogDebug(("Response Headers:\n%.*s", (int32_t)response.headersLen, response.pHeaders));
+    LogDebug(("Response Headers:\n%.*s", (int32_t)pxCtx->xResponse.headersLen, pxCtx->xResponse.pHeaders));
     LogInfo(("Response Body (%lu):\n%.*s\n",
-        response.bodyLen,
-        (int32_t)response.bodyLen,
-        response.pBody));
-    r->response = (char *) response.pBody;
-    r->response[response.bodyLen] = 0; // null terminate
-    status = (response.statusCode == 200) ? pdPASS : pdFAIL;
+        pxCtx->xResponse.bodyLen,
+        (int32_t)pxCtx->xResponse.bodyLen,
+        pxCtx->xResponse.pBody));
+    r->response = (char *) pxCtx->xResponse.pBody;
+    r->response[pxCtx->xResponse.bodyLen] = 0; // null terminate
+    status = (pxCtx->xResponse.statusCode == 200) ? pdPASS : pdFAIL;
+    *pxKeepOpen = (pxCtx->xResponse.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG) ? pdFALSE : pdTRUE;
 
     if (status != pdPASS) {
-        LogError(("Received an invalid response from the server Result: %u.", response.statusCode));
+        LogError(("Received an invalid response from the server Result: %u.", pxCtx->xResponse.statusCode));
     }
 
     return status;
 }
 
 
-int iotconnect_https_request(IotConnectHttpRequest* request)
+/**
+ * @brief State of a response that is streamed to the request's body callback.
+ */
+typedef struct {
+    IotConnectHttpRequest* r;
+    BaseType_t xBodyStarted;
+    BaseType_t xAborted;
+    BaseType_t xComplete;
+} StreamedResponse_t;
+
+static int prvOnStreamedBody(http_parser* pxParser, const char* pcData, size_t uxLength)
+{
+    StreamedResponse_t* pxStream = (StreamedResponse_t*) pxParser->data;
+
+    if (pxParser->status_code != 200) {
+        return 0; // only the body of a successful response is passed on
+    }
+    pxStream->xBodyStarted = pdTRUE;
+    if (pxStream->r->body_cb(pxStream->r->user_data, pcData, uxLength)) {
+        pxStream->xAborted = pdTRUE;
+        return 1; // stops the parser
+    }
+    return 0;
+}
+
+static int prvOnStreamedMessageComplete(http_parser* pxParser)
+{
+    ((StreamedResponse_t*) pxParser->data)->xComplete = pdTRUE;
+    return 0;
+}
+
+static BaseType_t prvTransportSendAll(const TransportInterface_t* pxTransport, const uint8_t* pucData, size_t uxLen)
+{
+    TickType_t xLastProgress = xTaskGetTickCount();
+
+    while (uxLen > 0) {
+        int32_t lSent = pxTransport->send(pxTransport->pNetworkContext, pucData, uxLen);
+        if (lSent < 0) {
+            return pdFAIL;
+        }
+        if (lSent == 0) {
+            if ((xTaskGetTickCount() - xLastProgress) >= pdMS_TO_TICKS(IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS)) {
+                return pdFAIL;
+            }
+            vTaskDelay(pdMS_TO_TICKS(HTTP_STREAM_RECV_POLL_MS));
+            continue;
+        }
+        xLastProgress = xTaskGetTickCount();
+        pucData += lSent;
+        uxLen -= (size_t) lSent;
+    }
+    return pdPASS;
+}
+
+// Same as prvClientRequest, but passes the body to r->body_cb as it arrives instead of collecting it in the context buffer.
+// The buffer holds the request headers and then each received chunk, so the response can be of any size.
+// pxBodyStarted receives whether any part of the body was passed to the callback. pxClosed is the same as in prvClientRequest.
+static BaseType_t prvClientStreamRequest(HttpClientContext_t* pxCtx, const TransportInterface_t* ptransportInterface, IotConnectHttpRequest* r, BaseType_t xReused, BaseType_t* pxKeepOpen, BaseType_t* pxBodyStarted, BaseType_t* pxClosed)
+{
+    HTTPStatus_t httpStatus;
+    http_parser xParser;
+    http_parser_settings xSettings;
+    StreamedResponse_t xStream = { 0 };
+    size_t uxPayloadLen = r->payload ? strlen(r->payload) : 0;
+    char pcContentLength[12];
+    BaseType_t xReceivedAny = pdFALSE;
+
+    *pxKeepOpen = pdFALSE;
+    *pxBodyStarted = pdFALSE;
+    *pxClosed = pdFALSE;
+
+    configASSERT(r->resource != NULL);
+
+    (void)memset(&pxCtx->xRequestHeaders, 0, sizeof(pxCtx->xRequestHeaders));
+    (void)memset(&pxCtx->xRequestInfo, 0, sizeof(pxCtx->xRequestInfo));
+
+    pxCtx->xRequestInfo.pHost = r->host_name;
+    pxCtx->xRequestInfo.hostLen = strlen(r->host_name);
+    pxCtx->xRequestInfo.pMethod = r->payload ? HTTP_METHOD_POST : HTTP_METHOD_GET;
+    pxCtx->xRequestInfo.methodLen = strlen(pxCtx->xRequestInfo.pMethod);
+    pxCtx->xRequestInfo.pPath = r->resource;
+    pxCtx->xRequestInfo.pathLen = strlen(r->resource);
+    if (IOTC_HTTP_CLIENT_KEEP_ALIVE_MS > 0) {
+        pxCtx->xRequestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+    }
+
+    pxCtx->xRequestHeaders.pBuffer = pxCtx->ucBuffer;
+    pxCtx->xRequestHeaders.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE;
+
+    httpStatus = HTTPClient_InitializeRequestHeaders(&pxCtx->xRequestHeaders, &pxCtx->xRequestInfo);
+    if (httpStatus == HTTPSuccess) {
+        httpStatus = HTTPClient_AddHeader(&pxCtx->xRequestHeaders,
+            "Content-Type", strlen("Content-Type"),
+            "application/json", strlen("application/json")
+        );
+    }
+    if (httpStatus == HTTPSuccess) {
+        // HTTPClient_Send() would add this one
+        (void)snprintf(pcContentLength, sizeof(pcContentLength), "%u", (unsigned int) uxPayloadLen);
+        httpStatus = HTTPClient_AddHeader(&pxCtx->xRequestHeaders,
+            "Content-Length", strlen("Content-Length"),
+            pcContentLength, strlen(pcContentLength)
+        );
+    }
+    if (httpStatus != HTTPSuccess) {
+        LogError(("Failed to initialize HTTP request headers: Error=%s.",
+            HTTPClient_strerror(httpStatus)));
+        return pdFAIL;
+    }
+
+    if (prvTransportSendAll(ptransportInterface, pxCtx->xRequestHeaders.pBuffer, pxCtx->xRequestHeaders.headersLen) != pdPASS
+        || prvTransportSendAll(ptransportInterface, (const uint8_t *) r->payload, uxPayloadLen) != pdPASS) {
+        if (xReused) {
+            *pxClosed = pdTRUE; // the server cannot act on a request that it did not get in full
+        } else {
+            LogError(("Failed to send HTTP request to %s%s.", r->host_name, r->resource));
+        }
+        return pdFAIL;
+    }
+
+    http_parser_init(&xParser, HTTP_RESPONSE);
+    http_parser_settings_init(&xSettings);
+    xSettings.on_body = prvOnStreamedBody;
+    xSettings.on_message_complete = prvOnStreamedMessageComplete;
+    xStream.r = r;
+    xParser.data = &xStream;
+
+    TickType_t xLastProgress = xTaskGetTickCount();
+    while (!xStream.xComplete) {
+        int32_t lReceived = ptransportInterface->recv(ptransportInterface->pNetworkContext, pxCtx->ucBuffer, IOTC_HTTP_CLIENT_USER_BUFFER_SIZE);
+        if (lReceived < 0) {
+            if (xReused && !xReceivedAny) {
+                *pxClosed = pdTRUE; // most likely closed by the server while idle
+                break;
+            }
+            // closed by the server. This also completes a response that is delimited by the connection close.
+            (void)http_parser_execute(&xParser, &xSettings, NULL, 0);
+            break;
+        }
+        if (lReceived == 0) {
+            // no data yet. A slow server is waited for the same way on a new and on a reused connection.
+            if ((xTaskGetTickCount() - xLastProgress) >= pdMS_TO_TICKS(IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS)) {
+                LogError(("Timed out while receiving the HTTP response from %s%s.", r->host_name, r->resource));
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(HTTP_STREAM_RECV_POLL_MS));
+            continue;
+        }
+        xReceivedAny = pdTRUE;
+        xLastProgress = xTaskGetTickCount();
+        size_t uxParsed = http_parser_execute(&xParser, &xSettings, (const char *) pxCtx->ucBuffer, (size_t) lReceived);
+        if (xStream.xAborted) {
+            LogError(("HTTP response from %s%s was rejected by the body callback.", r->host_name, r->resource));
+            break;
+        }
+        if (HTTP_PARSER_ERRNO(&xParser) != HPE_OK || uxParsed != (size_t) lReceived) {
+            LogError(("Failed to parse the HTTP response from %s%s: %s.", r->host_name, r->resource,
+                http_errno_name(HTTP_PARSER_ERRNO(&xParser))));
+            break;
+        }
+    }
+
+    *pxBodyStarted = xStream.xBodyStarted;
+    if (!xStream.xComplete) {
+        if (!*pxClosed) {
+            LogError(("Incomplete HTTP response from %s%s.", r->host_name, r->resource));
+        }
+        return pdFAIL;
+    }
+    *pxKeepOpen = http_should_keep_alive(&xParser) ? pdTRUE : pdFALSE;
+    if (xParser.status_code != 200) {
+        LogError(("Received an invalid response from the server Result: %u.", xParser.status_code));
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+static void prvInitLocks(void)
+{
+    if (!xClientLock) {
+        taskENTER_CRITICAL();
+        if (!xClientLock) {
+            xContextsAvailable = xSemaphoreCreateCountingStatic(IOTC_HTTP_CLIENT_POOL_SIZE, IOTC_HTTP_CLIENT_POOL_SIZE, &xContextsAvailableStorage);
+            xClientLock = xSemaphoreCreateMutexStatic(&xClientLockStorage);
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+static void prvLock(void)
+{
+    prvInitLocks();
+    ( void ) xSemaphoreTake(xClientLock, portMAX_DELAY);
+}
+
+static void prvUnlock(void)
+{
+    ( void ) xSemaphoreGive(xClientLock);
+}
+
+static HttpClientContext_t* prvAcquireContext(void)
+{
+    HttpClientContext_t* pxCtx = NULL;
+
+    prvInitLocks();
+    if (xSemaphoreTake(xContextsAvailable, pdMS_TO_TICKS(IOTC_HTTP_CLIENT_POOL_WAIT_MS)) != pdTRUE) {
+        return NULL;
+    }
+    prvLock();
+    for (size_t i = 0; i < IOTC_HTTP_CLIENT_POOL_SIZE; i++) {
+        if (!xClientContexts[i].xInUse) {
+            pxCtx = &xClientContexts[i];
+            pxCtx->xInUse = pdTRUE;
+            break;
+        }
+    }
+    prvUnlock();
+    configASSERT(pxCtx != NULL);
+    return pxCtx;
+}
+
+static void prvReleaseContext(HttpClientContext_t* pxCtx)
+{
+    prvLock();
+    pxCtx->xInUse = pdFALSE;
+    prvUnlock();
+    ( void ) xSemaphoreGive(xContextsAvailable);
+}
+
+static void prvCloseConnection(NetworkContext_t* pxNetworkContext)
+{
+    mbedtls_transport_disconnect(pxNetworkContext);
+    mbedtls_transport_free(pxNetworkContext);
+}
+
+// Closes the idle connections that expired, or all of them if xAll is set
+static void prvCloseIdleConnections(BaseType_t xAll)
+{
+    NetworkContext_t* pxToClose[IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS + 1]; // +1 avoids a zero length array
+    size_t uxNumToClose = 0;
+    TickType_t xNow = xTaskGetTickCount();
+
+    // connections are closed after unlocking, so that other requests do not wait for the TLS shutdown
+    prvLock();
+    for (size_t i = 0; i < IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS; i++) {
+        IdleConnection_t* pxIdle = &xIdleConnections[i];
+        if (pxIdle->pxNetworkContext && (xAll || (xNow - pxIdle->xLastUsed) >= pdMS_TO_TICKS(IOTC_HTTP_CLIENT_KEEP_ALIVE_MS))) {
+            LogDebug(("Closing idle connection to %s.", pxIdle->pcHostName));
+            pxToClose[uxNumToClose++] = pxIdle->pxNetworkContext;
+            pxIdle->pxNetworkContext = NULL;
+        }
+    }
+    prvUnlock();
+
+    for (size_t i = 0; i < uxNumToClose; i++) {
+        prvCloseConnection(pxToClose[i]);
+    }
+}
+
+// Removes an idle connection to the host from the cache and returns it
+static NetworkContext_t* prvTakeIdleConnection(const char* pcHostName)
+{
+    NetworkContext_t* pxNetworkContext = NULL;
+
+    prvLock();
+    for (size_t i = 0; i < IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS; i++) {
+        IdleConnection_t* pxIdle = &xIdleConnections[i];
+        if (pxIdle->pxNetworkContext && 0 == strcmp(pxIdle->pcHostName, pcHostName)) {
+            pxNetworkContext = pxIdle->pxNetworkContext;
+            pxIdle->pxNetworkContext = NULL;
+            break;
+        }
+    }
+    prvUnlock();
+    return pxNetworkContext;
+}
+
+// Keeps the connection open for the next request, replacing the least recently used one if needed
+static void prvPutIdleConnection(const char* pcHostName, NetworkContext_t* pxNetworkContext)
+{
+    IdleConnection_t* pxSlot = NULL;
+    NetworkContext_t* pxEvicted = NULL;
+    TickType_t xNow = xTaskGetTickCount();
+
+    if (IOTC_HTTP_CLIENT_KEEP_ALIVE_MS == 0 || IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS == 0 || strlen(pcHostName) > HTTP_HOST_NAME_MAX_LEN) {
+        prvCloseConnection(pxNetworkContext);
+        return;
+    }
+
+    prvLock();
+    for (size_t i = 0; i < IOTC_HTTP_CLIENT_MAX_IDLE_CONNECTIONS; i++) {
+        IdleConnection_t* pxIdle = &xIdleConnections[i];
+        if (!pxIdle->pxNetworkContext) {
+            pxSlot = pxIdle;
+            break;
+        }
+        if (!pxSlot || (xNow - pxIdle->xLastUsed) > (xNow - pxSlot->xLastUsed)) {
+            pxSlot = pxIdle; // idle for longer than the current candidate
+        }
+    }
+    pxEvicted = pxSlot->pxNetworkContext;
+    pxSlot->pxNetworkContext = pxNetworkContext;
+    strcpy(pxSlot->pcHostName, pcHostName);
+    pxSlot->xLastUsed = xNow;
+    prvUnlock();
+
+    if (pxEvicted) {
+        prvCloseConnection(pxEvicted);
+    }
+}
+
+#if IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE > 0
+// Must be called with the client lock held
+static void prvDropTlsSession(CachedTlsSession_t* pxEntry)
+{
+    if (pxEntry->xValid) {
+        mbedtls_ssl_session_free(&pxEntry->xSession);
+        pxEntry->xValid = pdFALSE;
+    }
+}
+
+// Returns the saved session for the host, if any, dropping the expired ones along the way.
+// Must be called with the client lock held.
+static CachedTlsSession_t* prvFindTlsSession(const char* pcHostName)
+{
+    TickType_t xNow = xTaskGetTickCount();
+    CachedTlsSession_t* pxFound = NULL;
+
+    for (size_t i = 0; i < IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE; i++) {
+        CachedTlsSession_t* pxEntry = &xTlsSessions[i];
+        if (!pxEntry->xValid) {
+            continue;
+        }
+        if ((xNow - pxEntry->xSaved) >= pdMS_TO_TICKS(IOTC_HTTP_CLIENT_TLS_SESSION_LIFETIME_MS)) {
+            prvDropTlsSession(pxEntry);
+        } else if (0 == strcmp(pxEntry->pcHostName, pcHostName)) {
+            pxFound = pxEntry;
+        }
+    }
+    return pxFound;
+}
+
+// Deep copies the session through its serialized form, so that the copy does not share the ticket with the cache entry
+static BaseType_t prvCopyTlsSession(mbedtls_ssl_session* pxDst, const mbedtls_ssl_session* pxSrc)
+{
+    size_t uxLen = 0;
+    BaseType_t xResult = pdFAIL;
+
+    if (mbedtls_ssl_session_save(pxSrc, NULL, 0, &uxLen) != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return pdFAIL;
+    }
+    unsigned char* pucBuf = pvPortMalloc(uxLen);
+    if (!pucBuf) {
+        return pdFAIL;
+    }
+    if (0 == mbedtls_ssl_session_save(pxSrc, pucBuf, uxLen, &uxLen) && 0 == mbedtls_ssl_session_load(pxDst, pucBuf, uxLen)) {
+        xResult = pdPASS;
+    }
+    vPortFree(pucBuf);
+    return xResult;
+}
+
+// Copies the saved session for the host into pxSession, which must be initialized by the caller.
+// The transport only keeps a pointer to the session it is given and reads it during the handshake,
+// so it gets this copy rather than the cache entry, which another request may replace in the meantime.
+// Returns pdTRUE if a session was found and copied.
+static BaseType_t prvCopyCachedTlsSession(const char* pcHostName, mbedtls_ssl_session* pxSession)
+{
+    BaseType_t xFound = pdFALSE;
+
+    prvLock();
+    CachedTlsSession_t* pxEntry = prvFindTlsSession(pcHostName);
+    if (pxEntry) {
+        if (prvCopyTlsSession(pxSession, &pxEntry->xSession) != pdPASS) {
+            prvDropTlsSession(pxEntry);
+        } else {
+            xFound = pdTRUE;
+            pxEntry->xLastUsed = xTaskGetTickCount();
+        }
+    }
+    prvUnlock();
+    return xFound;
+}
+
+static void prvForgetTlsSession(const char* pcHostName)
+{
+    prvLock();
+    CachedTlsSession_t* pxEntry = prvFindTlsSession(pcHostName);
+    if (pxEntry) {
+        prvDropTlsSession(pxEntry);
+    }
+    prvUnlock();
+}
+
+// Saves the session of a newly established connection, replacing the least recently used entry if needed.
+// Returns pdTRUE if the handshake resumed pxOffered, the session that was offered to the connection, if any.
+static BaseType_t prvSaveTlsSession(NetworkContext_t* pxNetworkContext, const char* pcHostName, const mbedtls_ssl_session* pxOffered)
+{
+    TickType_t xNow = xTaskGetTickCount();
+    CachedTlsSession_t* pxSlot;
+    mbedtls_ssl_session xSession;
+    BaseType_t xResumed = pdFALSE;
+
+    if (strlen(pcHostName) > HTTP_HOST_NAME_MAX_LEN) {
+        return pdFALSE;
+    }
+
+    mbedtls_ssl_session_init(&xSession);
+    if (mbedtls_transport_get_session(pxNetworkContext, &xSession) != pdPASS) {
+        mbedtls_ssl_session_free(&xSession);
+        return pdFALSE;
+    }
+
+    // A resumed session keeps the master secret, while a full handshake derives a new one.
+    // The session ID cannot tell, because with a session ticket the client offers a random ID that the server echoes.
+    // mbedtls has no public API for this, so the private field is read. See the transport patches in the README.
+    if (pxOffered && 0 == memcmp(pxOffered->MBEDTLS_PRIVATE(master), xSession.MBEDTLS_PRIVATE(master), sizeof(xSession.MBEDTLS_PRIVATE(master)))) {
+        xResumed = pdTRUE;
+    }
+
+    prvLock();
+    // reuse the host's entry, or take a free one, or evict the least recently used one
+    pxSlot = prvFindTlsSession(pcHostName);
+    if (!pxSlot) {
+        for (size_t i = 0; i < IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE; i++) {
+            CachedTlsSession_t* pxEntry = &xTlsSessions[i];
+            if (!pxEntry->xValid) {
+                pxSlot = pxEntry;
+                break;
+            }
+            if (!pxSlot || (xNow - pxEntry->xLastUsed) > (xNow - pxSlot->xLastUsed)) {
+                pxSlot = pxEntry;
+            }
+        }
+    }
+
+    prvDropTlsSession(pxSlot);
+    pxSlot->xSession = xSession; // takes over the allocations made by mbedtls_ssl_get_session
+    strcpy(pxSlot->pcHostName, pcHostName);
+    pxSlot->xSaved = xNow;
+    pxSlot->xLastUsed = xNow;
+    pxSlot->xValid = pdTRUE;
+    prvUnlock();
+
+    return xResumed;
+}
+#endif // IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE > 0
+
+static NetworkContext_t* prvOpenConnection(IotConnectHttpRequest* request)
 {
-    TransportInterface_t transportInterface;
     NetworkContext_t* networkContext;
-    BaseType_t status = pdPASS;
 
     networkContext = mbedtls_transport_allocate();
     if (!networkContext) {
     	LogError( "HTTP: Failed to allocate an mbedtls transport context." );
-    	return pdFALSE;
+    	return NULL;
     }
 
-    PkiObject_t httpsRootCaPkiObject = PKI_OBJ_PEM(CERT_GODADDY_INT_SECURE_G2, strlen(CERT_GODADDY_INT_SECURE_G2)+1);
+#if IOTC_HTTP_CLIENT_SHARED_CA_CHAIN
+    const mbedtls_x509_crt* pxCaChain = iotc_cert_store_get(request->tls_cert);
+    if (!pxCaChain
+        || mbedtls_transport_configure( networkContext, NULL, NULL, NULL, NULL, 0 )
+        || mbedtls_transport_set_ca_chain( networkContext, pxCaChain ) != pdPASS
+    		) {
+        LogError( "HTTP: Failed to configure mbedtls transport." );
+        mbedtls_transport_free(networkContext);
+        return NULL;
+    }
+#else
+    const unsigned char* pucCaDer = NULL;
+    size_t uxCaDerLen = 0;
+    if (iotc_cert_store_get_der(request->tls_cert, &pucCaDer, &uxCaDerLen)) {
+        LogError( "HTTP: Unknown CA certificate %d.", request->tls_cert );
+        mbedtls_transport_free(networkContext);
+        return NULL;
+    }
+    PkiObject_t httpsRootCaPkiObject = PKI_OBJ_DER(pucCaDer, uxCaDerLen);
     if (mbedtls_transport_configure( networkContext,
     		NULL,
 			NULL,
@@ -361,31 +931,153 @@ int iotconnect_https_request(IotConnectHttpRequest* request)
 			1 )
     		) {
         LogError( "HTTP: Failed to configure mbedtls transport." );
-        return pdFALSE;
+        mbedtls_transport_free(networkContext);
+        return NULL;
+    }
+#endif
+
+#if IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE > 0
+    mbedtls_ssl_session xResumeSession;
+    mbedtls_ssl_session_init(&xResumeSession);
+    BaseType_t xOffered = prvCopyCachedTlsSession(request->host_name, &xResumeSession);
+    if (xOffered && mbedtls_transport_set_session(networkContext, &xResumeSession) != pdPASS) {
+        xOffered = pdFALSE;
+    }
+#endif
+
+    BaseType_t xConnected = connectToServerWithBackoffRetriesV2(networkContext, request);
+    BaseType_t xResumed = pdFALSE;
+
+#if IOTC_HTTP_CLIENT_TLS_SESSION_CACHE_SIZE > 0
+    if (xOffered) {
+        ( void ) mbedtls_transport_set_session(networkContext, NULL); // the copy goes out of scope
+    }
+    if (xConnected == pdPASS) {
+        xResumed = prvSaveTlsSession(networkContext, request->host_name, xOffered ? &xResumeSession : NULL);
+    } else if (xOffered) {
+        prvForgetTlsSession(request->host_name); // in case the server rejects it in a way that fails the handshake
+    }
+    mbedtls_ssl_session_free(&xResumeSession);
+#endif
+
+    if (xConnected != pdPASS) {
+        mbedtls_transport_free(networkContext);
+        return NULL;
+    }
+
+    prvLock();
+    xHttpStats.handshakes++;
+    if (xResumed) {
+        xHttpStats.resumed_handshakes++;
+    }
+    prvUnlock();
+
+    vTaskDelay(pdMS_TO_TICKS(20)); // allow connection to establish to run to avoid "Zero returned from transport recv" error spam.
+
+    return networkContext;
+}
+
+void iotconnect_https_get_stats(IotConnectHttpStats* stats)
+{
+    prvLock();
+    *stats = xHttpStats;
+    prvUnlock();
+}
+
+void iotconnect_https_close_idle_connections(void)
+{
+    prvCloseIdleConnections(pdTRUE);
+}
+
+void iotconnect_https_release_response(IotConnectHttpRequest* request)
+{
+    if (request->context) {
+        prvReleaseContext((HttpClientContext_t*) request->context);
+        request->context = NULL;
+        request->response = NULL;
+    }
+}
+
+int iotconnect_https_request(IotConnectHttpRequest* request)
+{
+    TransportInterface_t transportInterface;
+    NetworkContext_t* networkContext;
+    HttpClientContext_t* pxCtx;
+    BaseType_t status = pdPASS;
+    BaseType_t xKeepOpen = pdFALSE;
+    BaseType_t xBodyStarted = pdFALSE;
+    TickType_t xStart = xTaskGetTickCount();
+    IotConnectHttpStats xStats;
+
+    // The caller may not have zero initialized the request, so the context is not released here
+    request->context = NULL;
+    request->response = NULL;
+
+    if (IOTC_CERT_NONE == request->tls_cert) {
+        LogError(("HTTP: No CA certificate is set for %s.", request->host_name));
+        return EXIT_FAILURE;
     }
 
+    pxCtx = prvAcquireContext();
+    if (!pxCtx) {
+        LogError(("HTTP: Timed out waiting for a free client context for %s. Is a response not released?", request->host_name));
+        return EXIT_FAILURE;
+    }
+
+    prvCloseIdleConnections(pdFALSE);
+
     BaseType_t tries = 0;
     do {
+        BaseType_t xReused = pdFALSE;
+        BaseType_t xClosed = pdFALSE;
 
-        // keep trying and break if tries is exceeded
-        status = connectToServerWithBackoffRetriesV2(networkContext, request);
-
-        if (status == pdFAIL) {
-            LogError(("Failed to connect to HTTP server %s. Tries so far %d...", request->host_name, tries));
+        networkContext = prvTakeIdleConnection(request->host_name);
+        if (networkContext) {
+            xReused = pdTRUE;
+        } else {
+            networkContext = prvOpenConnection(request);
         }
 
-        if (status == pdPASS) {
+        if (!networkContext) {
+            status = pdFAIL;
+            LogError(("Failed to connect to HTTP server %s. Tries so far %d...", request->host_name, tries));
+        } else {
             transportInterface.pNetworkContext = networkContext;
             transportInterface.send = mbedtls_transport_send;
             transportInterface.recv = mbedtls_transport_recv;
 
-            vTaskDelay(pdMS_TO_TICKS(20)); // allow connection to establish to run to avoid "Zero returned from transport recv" error spam.
-
-            status = prvClientRequest(&transportInterface, request);
-
-            // cleanup/disconnect
-            mbedtls_transport_disconnect(networkContext);
-            break;
+            uint32_t ulStart = iotc_metrics_start();
+            if (request->body_cb) {
+                status = prvClientStreamRequest(pxCtx, &transportInterface, request, xReused, &xKeepOpen, &xBodyStarted, &xClosed);
+            } else {
+                status = prvClientRequest(pxCtx, &transportInterface, request, xReused, &xKeepOpen, &xClosed);
+            }
+            iotc_metrics_end(IOTC_METRIC_HTTP_SEND, ulStart, status == pdPASS);
+
+            if (xKeepOpen) {
+                prvPutIdleConnection(request->host_name, networkContext);
+            } else {
+                prvCloseConnection(networkContext);
+            }
+
+            if (status == pdPASS) {
+                if (xReused) {
+                    prvLock();
+                    xHttpStats.reused++;
+                    prvUnlock();
+                }
+                break;
+            }
+            if (xBodyStarted) {
+                // The consumer already has a part of the body. It cannot be sent again.
+                LogError(("HTTP response from %s failed after a part of the body was received.", request->host_name));
+                break;
+            }
+            if (!xClosed) {
+                break;
+            }
+            // The server closed the idle connection before it got the request. Retry right away on a new one.
+            LogInfo(("Idle connection to %s was closed. Reconnecting...", request->host_name));
         }
 
         if (tries < MAX_HTTP_REQUEST_TRIES) {
@@ -396,13 +1088,29 @@ int iotconnect_https_request(IotConnectHttpRequest* request)
             break;
         }
 
-        vTaskDelay(HTTP_REQUEST_BACKOFF_MS);
+        if (!xClosed) {
+            vTaskDelay(HTTP_REQUEST_BACKOFF_MS);
+        }
         tries++;
 
+    } while (status != pdPASS);
 
+    if (status == pdPASS && !request->body_cb) {
+        request->context = pxCtx; // the response is in the context buffer until iotconnect_https_release_response()
+    } else {
+        prvReleaseContext(pxCtx);
+        request->response = NULL; // it may point into the released buffer
+    }
 
-    } while (status != pdPASS);
-    mbedtls_transport_free(networkContext);
+    prvLock();
+    xHttpStats.requests++;
+    xHttpStats.last_request_ms = ( uint32_t ) ((xTaskGetTickCount() - xStart) * portTICK_PERIOD_MS);
+    xHttpStats.total_request_ms += xHttpStats.last_request_ms;
+    xStats = xHttpStats;
+    prvUnlock();
+    LogInfo(("HTTP request to %s took %lu ms. Handshakes so far: %lu (%lu resumed), reused connections: %lu.",
+        request->host_name, xStats.last_request_ms, xStats.handshakes, xStats.resumed_handshakes, xStats.reused));
+    ( void ) xStats; // in case LogInfo is compiled out
 
     if (status == pdPASS) {
         return EXIT_SUCCESS;
@@ -0,0 +1,91 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+#include "iotc_storage_lfs.h"
+
+typedef struct {
+    lfs_t *lfs;
+    lfs_file_t file;
+} LfsStorageCtx_t;
+
+static int prvLfsRead(void *ctx, size_t offset, void *buf, size_t len) {
+    LfsStorageCtx_t *pxCtx = ( LfsStorageCtx_t * ) ctx;
+    lfs_ssize_t xRead;
+
+    if (lfs_file_seek(pxCtx->lfs, &pxCtx->file, ( lfs_soff_t ) offset, LFS_SEEK_SET) < 0) {
+        return -1;
+    }
+    xRead = lfs_file_read(pxCtx->lfs, &pxCtx->file, buf, ( lfs_size_t ) len);
+    if (xRead < 0) {
+        return -1;
+    }
+    // regions that were never written read back as zeros
+    if (( size_t ) xRead < len) {
+        memset(( uint8_t * ) buf + xRead, 0, len - ( size_t ) xRead);
+    }
+    return 0;
+}
+
+static int prvLfsWrite(void *ctx, size_t offset, const void *buf, size_t len) {
+    LfsStorageCtx_t *pxCtx = ( LfsStorageCtx_t * ) ctx;
+
+    if (lfs_file_seek(pxCtx->lfs, &pxCtx->file, ( lfs_soff_t ) offset, LFS_SEEK_SET) < 0) {
+        return -1;
+    }
+    return (lfs_file_write(pxCtx->lfs, &pxCtx->file, buf, ( lfs_size_t ) len) != ( lfs_ssize_t ) len) ? -1 : 0;
+}
+
+// Commits the writes since the last sync. littlefs is copy on write, so until then a reset rolls the file back.
+static int prvLfsSync(void *ctx) {
+    LfsStorageCtx_t *pxCtx = ( LfsStorageCtx_t * ) ctx;
+
+    return (lfs_file_sync(pxCtx->lfs, &pxCtx->file) < 0) ? -1 : 0;
+}
+
+int iotc_storage_lfs_open(IotConnectStorage *storage, lfs_t *lfs, const char *path, size_t size) {
+    LfsStorageCtx_t *pxCtx;
+
+    if (!storage || !lfs || !path || !size) {
+        return EXIT_FAILURE;
+    }
+
+    pxCtx = ( LfsStorageCtx_t * ) pvPortMalloc(sizeof(LfsStorageCtx_t));
+    if (!pxCtx) {
+        LogError( "Failed to allocate the storage context for %s.", path );
+        return EXIT_FAILURE;
+    }
+    memset(pxCtx, 0, sizeof(LfsStorageCtx_t));
+    pxCtx->lfs = lfs;
+
+    if (lfs_file_open(lfs, &pxCtx->file, path, LFS_O_RDWR | LFS_O_CREAT) < 0) {
+        LogError( "Failed to open storage file %s.", path );
+        vPortFree(pxCtx);
+        return EXIT_FAILURE;
+    }
+
+    storage->ctx = pxCtx;
+    storage->size = size;
+    storage->read = prvLfsRead;
+    storage->write = prvLfsWrite;
+    storage->sync = prvLfsSync;
+    return EXIT_SUCCESS;
+}
+
+void iotc_storage_lfs_close(IotConnectStorage *storage) {
+    LfsStorageCtx_t *pxCtx;
+
+    if (!storage || !storage->ctx) {
+        return;
+    }
+    pxCtx = ( LfsStorageCtx_t * ) storage->ctx;
+    ( void ) lfs_file_close(pxCtx->lfs, &pxCtx->file);
+    vPortFree(pxCtx);
+    storage->ctx = NULL;
+}
@@ -14,99 +14,153 @@
 #include "app_config.h"
 
 #define APP_VERSION "00.01.00"
+#define APP_METRICS_REPORT_INTERVAL_MS (300 * 1000)
+#define APP_TELEMETRY_INTERVAL_MS 1000
+#define APP_WINDOW_MS 30000 // each summary covers the last 30 seconds
+#define APP_SUB_WINDOWS 3 // and one is sent every 10 seconds
 
 #undef printf
 #define printf LogInfo
 
-static void command_status(IotclEventData data, bool status, const char *command_name, const char *message) {
+// The command view points into the C2D task buffer, so it stays valid after the event is destroyed
+static void command_status(IotclEventData data, bool status, const IotConnectStringView *command, const char *message) {
     const char *ack = iotcl_create_ack_string_and_destroy_event(data, status, message);
-    printf("command: %s status=%s: %s\n", command_name, status ? "OK" : "Failed", message);
+    printf("command: %.*s status=%s: %s\n", (int) command->len, command->data, status ? "OK" : "Failed", message);
     printf("Sent CMD ack: %s\n", ack);
-    iotconnect_sdk_send_packet(ack);
+    iotconnect_sdk_send_ack(ack);
     free((void *) ack);
 }
 
 static void on_command(IotclEventData data) {
-    char *command = iotcl_clone_command(data);
-    if (NULL != command) {
-        command_status(data, false, command, "Not implemented");
-        free((void *) command);
+    IotConnectStringView command;
+    if (EXIT_SUCCESS == iotconnect_sdk_event_get_command(&command)) {
+        printf("command: %.*s\n", (int) command.len, command.data);
+        command_status(data, false, &command, "Not implemented");
     } else {
-        command_status(data, false, "?", "Internal error");
+        const IotConnectStringView unknown = {"?", 1};
+        command_status(data, false, &unknown, "Internal error");
     }
 }
 
-static bool is_app_version_same_as_ota(const char *version) {
-    return strcmp(APP_VERSION, version) == 0;
+static bool on_app_version_command(void *user_data, int argc, const IotConnectStringView *argv, const char **ack_message) {
+    (void) user_data;
+    (void) argc;
+    (void) argv;
+    *ack_message = APP_VERSION;
+    return true;
 }
 
-static bool app_needs_ota_update(const char *version) {
-    return strcmp(APP_VERSION, version) < 0;
+// An example of a long running command. It runs in an SDK worker task, so other commands are handled in the meantime.
+static bool on_calibrate_command(void *user_data, int argc, const IotConnectStringView *argv, const char **ack_message) {
+    (void) user_data;
+    (void) argc;
+    (void) argv;
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    *ack_message = "Calibrated";
+    return true;
+}
+
+// Compares the app version with the OTA version like strcmp()
+static int compare_app_version(const IotConnectStringView *version) {
+    size_t app_len = strlen(APP_VERSION);
+    int ret = strncmp(APP_VERSION, version->data, app_len < version->len ? app_len : version->len);
+    if (ret == 0 && app_len != version->len) {
+        ret = app_len < version->len ? -1 : 1;
+    }
+    return ret;
 }
 
 static void on_ota(IotclEventData data) {
     const char *message = NULL;
-    char *url = iotcl_clone_download_url(data, 0);
+    IotConnectStringView url;
+    IotConnectStringView version;
     bool success = false;
-    if (NULL != url) {
-        printf("Download URL is: %s\n", url);
-        const char *version = iotcl_clone_sw_version(data);
-        if (is_app_version_same_as_ota(version)) {
-            printf("OTA request for same version %s. Sending success\n", version);
+    if (EXIT_SUCCESS == iotconnect_sdk_event_get_download_url(0, &url)) {
+        printf("Download URL is: %.*s\n", (int) url.len, url.data);
+        if (EXIT_SUCCESS != iotconnect_sdk_event_get_sw_version(&version)) {
+            message = "Missing version";
+        } else if (compare_app_version(&version) == 0) {
+            printf("OTA request for same version %.*s. Sending success\n", (int) version.len, version.data);
             success = true;
             message = "Version is matching";
-        } else if (app_needs_ota_update(version)) {
-            printf("OTA update is required for version %s.\n", version);
+        } else if (compare_app_version(&version) < 0) {
+            printf("OTA update is required for version %.*s.\n", (int) version.len, version.data);
             success = false;
             message = "Not implemented";
         } else {
-            printf("Device firmware version %s is newer than OTA version %s. Sending failure\n", APP_VERSION,
-                   version);
+            printf("Device firmware version %s is newer than OTA version %.*s. Sending failure\n", APP_VERSION,
+                   (int) version.len, version.data);
             // Not sure what to do here. The app version is better than OTA version.
             // Probably a development version, so return failure?
             // The user should decide here.
             success = false;
             message = "Device firmware version is newer";
         }
-
-        free((void *) url);
-        free((void *) version);
     } else {
         // compatibility with older events
         // This app does not support FOTA with older back ends, but the user can add the functionality
-        const char *command = iotcl_clone_command(data);
-        if (NULL != command) {
+        IotConnectStringView command;
+        if (EXIT_SUCCESS == iotconnect_sdk_event_get_command(&command)) {
             // URL will be inside the command
-            printf("Command is: %s\n", command);
+            printf("Command is: %.*s\n", (int) command.len, command.data);
             message = "Old back end URLS are not supported by the app";
-            free((void *) command);
         }
     }
     const char *ack = iotcl_create_ack_string_and_destroy_event(data, success, message);
     if (NULL != ack) {
         printf("Sent OTA ack: %s\n", ack);
-        iotconnect_sdk_send_packet(ack);
+        iotconnect_sdk_send_ack(ack);
         free((void *) ack);
     }
 }
 
 
+// Report by exception: the values are written every second, but only the ones that changed beyond
+// their deadband, or were not reported for max_silence_ms, are added to the telemetry batch.
+enum { ATTR_VERSION, ATTR_CPU, ATTR_COUNT };
+static const IotConnectAttributeConfig attribute_configs[ATTR_COUNT] = {
+    [ATTR_VERSION] = { .name = "version", .type = IOTC_ATTRIBUTE_STRING, .max_silence_ms = 10 * 60 * 1000 },
+    [ATTR_CPU] = { .name = "cpu", .type = IOTC_ATTRIBUTE_NUMBER, .deadband = 0.5, .max_silence_ms = 60 * 1000 },
+};
+static IotConnectAttribute attributes[ATTR_COUNT];
+static IotConnectAttributeTable attribute_table;
+
 void publish_telemetry() {
-    IotclMessageHandle msg = iotcl_telemetry_create(iotconnect_sdk_get_lib_config());
-
-    // Optional. The first time you create a data point, the current timestamp will be automatically added
-    // TelemetryAddWith* calls are only required if sending multiple data points in one packet.
-    iotcl_telemetry_add_with_iso_time(msg, iotcl_iso_timestamp_now());
-    iotcl_telemetry_set_string(msg, "version", APP_VERSION);
-    iotcl_telemetry_set_number(msg, "cpu", 3.123); // test floating point numbers
-
-    const char *str = iotcl_create_serialized_string(msg, false);
-    iotcl_telemetry_destroy(msg);
-    printf("Sending: %s\n", str);
-    iotconnect_sdk_send_packet(str); // underlying code will report an error
-    iotcl_destroy_serialized(str);
+    iotc_attributes_set_string(&attribute_table, ATTR_VERSION, APP_VERSION);
+    iotc_attributes_set_number(&attribute_table, ATTR_CPU, 3.123); // test floating point numbers
+    // The data point is added to a batch which is sent once one of the config->batch limits is reached.
+    iotconnect_sdk_batch_report_attributes(&attribute_table); // underlying code will report an error
+}
+
+// Simulated sensors. The sampler task reads them on fixed deadlines and passes the values to the main loop,
+// which summarizes them over a sliding window, so that the 100 Hz vibration readings are sent as one data point every 10 seconds.
+enum { SENSOR_VIBRATION, SENSOR_TEMPERATURE, SENSOR_COUNT };
+
+static bool read_vibration(void *user_data, double *value) {
+    (void) user_data;
+    *value = (double) (rand() % 2001) / 1000.0 - 1.0;
+    return true;
+}
+
+static bool read_temperature(void *user_data, double *value) {
+    (void) user_data;
+    *value = 25.0 + (double) (rand() % 100) / 100.0;
+    return true;
 }
 
+static const IotConnectSamplerConfig sampler_configs[SENSOR_COUNT] = {
+    [SENSOR_VIBRATION] = { .name = "vibration", .period_ms = 10, .cb = read_vibration },
+    [SENSOR_TEMPERATURE] = { .name = "temperature", .period_ms = 1000, .cb = read_temperature },
+};
+static const IotConnectAggregateAttribute aggregate_attrs[SENSOR_COUNT] = {
+    [SENSOR_VIBRATION] = { .name = "vibration", .range_min = -1.0, .range_max = 1.0,
+                           .outputs = IOTC_AGGREGATE_MIN | IOTC_AGGREGATE_MAX | IOTC_AGGREGATE_STDDEV | IOTC_AGGREGATE_P99 },
+    [SENSOR_TEMPERATURE] = { .name = "temperature", .range_min = -20.0, .range_max = 80.0,
+                             .outputs = IOTC_AGGREGATE_MEAN | IOTC_AGGREGATE_MAX },
+};
+static IotConnectWindowStats aggregate_storage[SENSOR_COUNT * APP_SUB_WINDOWS];
+static IotConnectAggregator aggregator;
+
 void iotconnect_app_main(void) {
 
     IotConnectClientConfig *config = iotconnect_sdk_init_and_get_config();
@@ -114,8 +168,18 @@ void iotconnect_app_main(void) {
     config->env = IOTCONNECT_ENV;
     config->duid = IOTCONNECT_DUID;
 
+    iotc_attributes_init(&attribute_table, attributes, attribute_configs, ATTR_COUNT);
+    iotc_aggregator_init(&aggregator, aggregate_attrs, SENSOR_COUNT, aggregate_storage, APP_WINDOW_MS, APP_SUB_WINDOWS);
+
     config->ota_cb = on_ota;
     config->cmd_cb = on_command;
+    iotconnect_sdk_register_command("app-version", on_app_version_command, NULL);
+    iotconnect_sdk_register_async_command("calibrate", on_calibrate_command, NULL, 10000);
+
+    config->batch.max_points = 10;
+    config->batch.max_bytes = 2048;
+    config->batch.max_age_ms = 10000;
+    config->telemetry_delivery = IOTC_DELIVERY_QOS0; // the next sample will follow shortly if one is lost
 
     vSleepUntilMQTTAgentReady();
 
@@ -128,9 +192,30 @@ void iotconnect_app_main(void) {
     }
 
 
-    // run a dozen connect/send/disconnect cycles with each cycle being about a minute
-    while (true) {
-    	publish_telemetry();
-        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        iotc_sampler_register(&sampler_configs[i]); // the ids match the aggregator indexes
+    }
+    iotc_sampler_start();
+
+    TickType_t last_telemetry = xTaskGetTickCount();
+    TickType_t last_metrics_report = last_telemetry;
+    for (;;) {
+        IotConnectSample samples[16];
+        size_t num_samples = iotc_sampler_receive(samples, sizeof(samples) / sizeof(samples[0]), 100);
+        for (size_t i = 0; i < num_samples; i++) {
+            iotc_aggregator_add(&aggregator, samples[i].sampler, samples[i].value);
+        }
+        iotconnect_sdk_batch_report_aggregates(&aggregator);
+        iotconnect_sdk_batch_poll(); // for batch.max_age_ms
+
+        TickType_t now = xTaskGetTickCount();
+        if (now - last_telemetry >= pdMS_TO_TICKS(APP_TELEMETRY_INTERVAL_MS)) {
+            last_telemetry = now;
+            publish_telemetry();
+        }
+        if (now - last_metrics_report >= pdMS_TO_TICKS(APP_METRICS_REPORT_INTERVAL_MS)) {
+            last_metrics_report = now;
+            iotconnect_sdk_send_metrics_report();
+        }
     }
 }
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+#
+# Copyright: Avnet 2022
+#
+# Generates the DER certificate blobs for the certificate store from the PEM files in the certs directory.
+# Identical certificates are stored once. Each file name becomes a certificate ID, so
+# certs/godaddy_secure_g2.pem becomes IOTC_CERT_GODADDY_SECURE_G2.
+#
+# Run from the repository root after adding or changing a certificate:
+#   python3 scripts/gen_cert_store.py
+#
+# The generated files are checked in, so the IDE build does not need Python.
+
+import base64
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CERTS_DIR = os.path.join(ROOT, 'certs')
+OUT_H = os.path.join(ROOT, 'include', 'iotconnect_certs_der.h')
+OUT_C = os.path.join(ROOT, 'src', 'iotconnect_certs_der.c')
+
+HEADER = '''//
+// Copyright: Avnet 2022
+//
+// Generated by scripts/gen_cert_store.py from the files in the certs directory. Do not edit.
+//
+'''
+
+
+def read_pem_der(path):
+    with open(path) as f:
+        pem = f.read()
+    m = re.search(r'-----BEGIN CERTIFICATE-----(.*?)-----END CERTIFICATE-----', pem, re.S)
+    if not m:
+        sys.exit('%s: no certificate found' % path)
+    return base64.b64decode(''.join(m.group(1).split()))
+
+
+def main():
+    names = sorted(f[:-len('.pem')] for f in os.listdir(CERTS_DIR) if f.endswith('.pem'))
+    blobs = []  # unique DER blobs, in order
+    cert_ids = []  # (id name, blob index)
+    for name in names:
+        der = read_pem_der(os.path.join(CERTS_DIR, name + '.pem'))
+        if der in blobs:
+            print('%s.pem is a duplicate. Storing it once.' % name)
+        else:
+            blobs.append(der)
+        cert_ids.append(('IOTC_CERT_' + re.sub(r'\W', '_', name).upper(), blobs.index(der)))
+
+    with open(OUT_H, 'w', newline='\n') as f:
+        f.write(HEADER)
+        f.write('\n#ifndef IOTCONNECT_CERTS_DER_H\n#define IOTCONNECT_CERTS_DER_H\n\n')
+        f.write('#include <stddef.h>\n\n')
+        f.write('#ifdef __cplusplus\nextern   "C" {\n#endif\n\n')
+        f.write('typedef enum {\n')
+        f.write('    IOTC_CERT_NONE = 0, // not set. Zero initialized requests have no certificate rather than the first one.\n')
+        for i in range(len(blobs)):
+            aliases = [n for n, b in cert_ids if b == i]
+            f.write('    %s = %d,\n' % (aliases[0], i + 1))
+            for alias in aliases[1:]:
+                f.write('    %s = %s, // identical certificate\n' % (alias, aliases[0]))
+        f.write('    IOTC_CERT_BUILTIN_COUNT = %d\n' % len(blobs))
+        f.write('} IotcCertId;\n\n')
+        f.write('typedef struct {\n    const unsigned char *der;\n    size_t der_len;\n} IotcDerCert;\n\n')
+        f.write('// Indexed by IotcCertId - 1\n')
+        f.write('extern const IotcDerCert iotc_builtin_certs[IOTC_CERT_BUILTIN_COUNT];\n\n')
+        f.write('#ifdef __cplusplus\n}\n#endif\n\n#endif // IOTCONNECT_CERTS_DER_H\n')
+
+    with open(OUT_C, 'w', newline='\n') as f:
+        f.write(HEADER)
+        f.write('\n#include "iotconnect_certs_der.h"\n')
+        for i, der in enumerate(blobs):
+            f.write('\n// %s\n' % ', '.join(n for n, b in cert_ids if b == i))
+            f.write('static const unsigned char cert_der_%d[%d] = {\n' % (i, len(der)))
+            for off in range(0, len(der), 16):
+                f.write('    ' + ', '.join('0x%02x' % c for c in der[off:off + 16]) + ',\n')
+            f.write('};\n')
+        f.write('\nconst IotcDerCert iotc_builtin_certs[IOTC_CERT_BUILTIN_COUNT] = {\n')
+        for i in range(len(blobs)):
+            f.write('    { cert_der_%d, sizeof(cert_der_%d) },\n' % (i, i))
+        f.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
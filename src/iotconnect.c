@@ -31,6 +31,8 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
+#include "queue.h"
 
 #include "iotc_device_client.h"
 
@@ -41,20 +43,241 @@
 
 #include "iotc_device_client.h"
 #include "iotconnect_sync.h"
+#include "iotconnect_json_stream.h"
+#include "iotconnect_timestamp.h"
 #include "iotconnect.h"
 
+// Initial guess of the serialized size of a single data point used to estimate the batch size.
+// The estimate is refined with the actual size after each batch is sent.
+#ifndef IOTC_BATCH_INITIAL_POINT_SIZE
+#define IOTC_BATCH_INITIAL_POINT_SIZE 128
+#endif
+
+// Most data points that a batch held back by the rate limit can collect. Later points are dropped until it is sent.
+#ifndef IOTC_RATE_MAX_HELD_POINTS
+#define IOTC_RATE_MAX_HELD_POINTS 100
+#endif
+
+// Largest message that can be stored in the outbox. Larger messages are rejected when they would be stored.
+#ifndef IOTC_OUTBOX_MAX_MESSAGE_SIZE
+#define IOTC_OUTBOX_MAX_MESSAGE_SIZE 2048
+#endif
+
+// Messages that the broker did not take, waiting for the next drain to store them in the outbox
+#ifndef IOTC_OUTBOX_RETRY_QUEUE_LEN
+#define IOTC_OUTBOX_RETRY_QUEUE_LEN 8
+#endif
+
+// Completions of the stored messages, waiting for the next drain to remove the messages from the outbox.
+// Should be at least the number of backlog messages that the device client can queue and have in flight.
+#ifndef IOTC_OUTBOX_ACK_QUEUE_LEN
+#define IOTC_OUTBOX_ACK_QUEUE_LEN 16
+#endif
+
+// Size of the command handler table. Must be a power of 2. Up to 3/4 of the entries can be used.
+#ifndef IOTC_COMMAND_TABLE_SIZE
+#define IOTC_COMMAND_TABLE_SIZE 16
+#endif
+
+// Words in a command, including the command name. The last argument gets the rest of the command line.
+#ifndef IOTC_COMMAND_MAX_ARGS
+#define IOTC_COMMAND_MAX_ARGS 8
+#endif
+
+// Async commands run in a pool of worker tasks
+#ifndef IOTC_COMMAND_WORKERS
+#define IOTC_COMMAND_WORKERS 2
+#endif
+
+// Async commands that can be queued or running at the same time. Any more get a failure ack right away.
+#ifndef IOTC_COMMAND_MAX_PENDING
+#define IOTC_COMMAND_MAX_PENDING 4
+#endif
+
+// Longest command line of an async command. Async commands are copied,
+// because the event payload is overwritten by the next inbound message.
+#ifndef IOTC_COMMAND_MAX_LEN
+#define IOTC_COMMAND_MAX_LEN 256
+#endif
+
+#ifndef IOTC_COMMAND_WORKER_STACK_SIZE
+#define IOTC_COMMAND_WORKER_STACK_SIZE 4096
+#endif
+
+// The task that sends the failure acks of the async commands that are past their deadline
+#ifndef IOTC_COMMAND_TIMEOUT_STACK_SIZE
+#define IOTC_COMMAND_TIMEOUT_STACK_SIZE 2048
+#endif
+
+#ifndef IOTC_COMMAND_WORKER_PRIORITY
+#define IOTC_COMMAND_WORKER_PRIORITY (tskIDLE_PRIORITY + 2)
+#endif
+
+// How often the deadlines of the pending async commands are checked
+#ifndef IOTC_COMMAND_TIMEOUT_CHECK_MS
+#define IOTC_COMMAND_TIMEOUT_CHECK_MS 100
+#endif
+
+typedef struct {
+    const char *name; // NULL if the entry is free
+    size_t name_len;
+    uint32_t hash;
+    IotConnectCommandHandler handler;
+    void *user_data;
+    uint32_t timeout_ms; // 0 if the handler runs in the C2D task
+} CommandEntry;
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_TIMED_OUT // the failure ack was sent, but the worker still has the job
+} CommandJobState;
+
+// An async command. Only the worker that took the job from the queue can free it,
+// and the ack is sent by whoever changes the state from queued or running, so it is sent exactly once.
+typedef struct {
+    CommandJobState state;
+    IotclEventData data; // owned by the job until the ack is created
+    const CommandEntry *entry;
+    char command[IOTC_COMMAND_MAX_LEN];
+    size_t command_len;
+    TickType_t submitted;
+} CommandJob;
+
+typedef struct {
+    SemaphoreHandle_t lock;
+    IotclMessageHandle msg;
+    unsigned int num_points;
+    size_t point_size_estimate;
+    TickType_t first_point_tick;
+    volatile bool flush_requested; // a flush was requested while the batch was locked. Written in a critical section.
+    bool held; // a batch limit was reached, but the rate limit held the batch back
+} TelemetryBatch;
+
+// Token bucket for the telemetry messages, kept as milliseconds of credit. Guarded by batch.lock.
+typedef struct {
+    int64_t credit_ms; // each message costs the interval. Goes negative when a flush skips the limit.
+    TickType_t last_tick;
+    bool started;
+    IotConnectRateStats stats;
+} RateGovernor;
+
 static IotclConfig lib_config = { 0 };
 static IotConnectClientConfig config = { 0 };
+static TelemetryBatch batch = { 0 };
+static RateGovernor rate = { 0 };
 
-static void on_mqtt_c2d_message(unsigned char* message, size_t message_len) {
-    char* str = malloc(message_len + 1);
-    memcpy(str, message, message_len);
-    str[message_len] = 0;
-    printf("event>>> %s\n", str);
-    if (!iotcl_process_event(str)) {
-        fprintf(stderr, "Error encountered while processing %s\n", str);
+static CommandEntry command_table[IOTC_COMMAND_TABLE_SIZE];
+static unsigned int num_commands = 0;
+static unsigned int num_async_commands = 0;
+
+static CommandJob command_jobs[IOTC_COMMAND_MAX_PENDING];
+static uint8_t command_queue_storage[IOTC_COMMAND_MAX_PENDING * sizeof(CommandJob *)];
+static StaticQueue_t command_queue_struct;
+static QueueHandle_t command_queue = NULL; // jobs waiting for a worker
+static StaticSemaphore_t command_lock_storage;
+static SemaphoreHandle_t command_lock = NULL; // guards the job states and the command stats
+static TaskHandle_t command_timeout_task_handle = NULL; // checks the deadlines while there are pending jobs
+static IotConnectCommandStats command_stats;
+
+static IotConnectOutbox outbox;
+static bool outbox_enabled = false;
+static SemaphoreHandle_t outbox_lock = NULL; // guards the outbox state
+static SemaphoreHandle_t outbox_drain_lock = NULL; // only one task can drain at a time. Guards outbox_drain_buffer.
+static char outbox_drain_buffer[IOTC_OUTBOX_MAX_MESSAGE_SIZE + 1];
+
+typedef struct {
+    char *data; // allocated copy
+    size_t len;
+} OutboxRetry;
+
+static uint8_t outbox_retry_queue_storage[IOTC_OUTBOX_RETRY_QUEUE_LEN * sizeof(OutboxRetry)];
+static StaticQueue_t outbox_retry_queue_struct;
+static QueueHandle_t outbox_retry_queue = NULL;
+static volatile uint32_t outbox_retries_lost = 0; // failed messages that could not be queued for storing
+
+typedef struct {
+    uint32_t id; // from iotc_outbox_peek_unsent()
+    int status;
+} OutboxAck;
+
+static uint8_t outbox_ack_queue_storage[IOTC_OUTBOX_ACK_QUEUE_LEN * sizeof(OutboxAck)];
+static StaticQueue_t outbox_ack_queue_struct;
+static QueueHandle_t outbox_ack_queue = NULL;
+static volatile bool outbox_ack_lost = false; // a completion could not be queued, so the in-flight messages are sent again
+
+// Payload of the event that is being processed, or NULL. Used for the string views returned by iotconnect_sdk_event_get_*().
+static const char* event_payload = NULL;
+static size_t event_payload_len = 0;
+
+// Called from the C2D task. The message is null terminated in the task's receive buffer, so it is parsed in place.
+static void on_mqtt_c2d_message(const char* message, size_t message_len) {
+    event_payload = message;
+    event_payload_len = message_len;
+    if (!iotcl_process_event(message)) {
+        fprintf(stderr, "Error encountered while processing %s\n", message);
     }
-    free(str);
+    event_payload = NULL;
+    event_payload_len = 0;
+}
+
+typedef struct {
+    IotConnectStringView *view;
+    bool found;
+} EventViewLookup;
+
+static bool on_event_view_value(void *user_data, size_t path_index, const char *value, size_t value_len, bool is_string) {
+    EventViewLookup *lookup = (EventViewLookup *) user_data;
+    (void) path_index;
+    if (!is_string) {
+        return true; // keep looking
+    }
+    lookup->view->data = value;
+    lookup->view->len = value_len;
+    lookup->found = true;
+    return false; // found it. No need to scan the rest.
+}
+
+// Scans the current event payload for the first string at any of the paths.
+// The whole payload is fed as one chunk, so the view points into the payload and nothing is copied.
+static int event_get_view(const char *const *paths, size_t num_paths, IotConnectStringView *view) {
+    IotConnectJsonStream js;
+    EventViewLookup lookup = {view, false};
+
+    view->data = NULL;
+    view->len = 0;
+    if (!event_payload) {
+        fprintf(stderr, "Error: Event fields can only be read from the event callbacks\n");
+        return EXIT_FAILURE;
+    }
+    iotc_json_stream_init(&js, paths, num_paths, on_event_view_value, &lookup);
+    (void) iotc_json_stream_feed(&js, event_payload, event_payload_len);
+    return lookup.found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int iotconnect_sdk_event_get_command(IotConnectStringView *command) {
+    static const char *const paths[] = {"data.command"}; // the field read by iotcl_clone_command()
+    return event_get_view(paths, 1, command);
+}
+
+int iotconnect_sdk_event_get_download_url(unsigned int index, IotConnectStringView *url) {
+    char object_path[32];
+    char string_path[32];
+    const char *const paths[] = {object_path, string_path};
+    snprintf(object_path, sizeof(object_path), "data.urls.%u.url", index);
+    snprintf(string_path, sizeof(string_path), "data.urls.%u", index); // older back ends send an array of strings
+    return event_get_view(paths, 2, url);
+}
+
+int iotconnect_sdk_event_get_sw_version(IotConnectStringView *version) {
+    static const char *const paths[] = {"data.ver.sw"};
+    return event_get_view(paths, 1, version);
+}
+
+int iotconnect_sdk_event_get_ack_id(IotConnectStringView *ack_id) {
+    static const char *const paths[] = {"data.ackId"};
+    return event_get_view(paths, 1, ack_id);
 }
 
 bool iotconnect_sdk_is_connected() {
@@ -74,6 +297,8 @@ static void on_message_intercept(IotclEventData data, IotConnectEventType type)
     switch (type) {
     case ON_FORCE_SYNC:
         printf("Got a SYNC request request.\n");
+        // do not hold up the C2D task with the HTTPS requests
+        iotc_sync_request_resync();
         break;
     case ON_CLOSE:
         printf("Got a disconnect request.\n");
@@ -87,8 +312,942 @@ static void on_message_intercept(IotclEventData data, IotConnectEventType type)
     }
 }
 
+static int outbox_store(const char *data, size_t len) {
+    int ret;
+    TickType_t start = xTaskGetTickCount();
+
+    if (len > IOTC_OUTBOX_MAX_MESSAGE_SIZE) {
+        // it could be stored, but the drain could never send it
+        fprintf(stderr, "Error: Message of %u bytes is too large for the outbox. Increase IOTC_OUTBOX_MAX_MESSAGE_SIZE.\n",
+                (unsigned int) len);
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        outbox.stats.rejected++;
+        xSemaphoreGive(outbox_lock);
+        return EXIT_FAILURE;
+    }
+
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    ret = iotc_outbox_append(&outbox, data, len);
+    uint32_t elapsed_ms = (uint32_t) ((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+    outbox.stats.append_time_total_ms += elapsed_ms;
+    if (elapsed_ms > outbox.stats.append_time_max_ms) {
+        outbox.stats.append_time_max_ms = elapsed_ms;
+    }
+    xSemaphoreGive(outbox_lock);
+
+    if (ret) {
+        fprintf(stderr, "Error: Failed to store a message of %u bytes in the outbox\n", (unsigned int) len);
+    }
+    return ret;
+}
+
+// Called from the MQTT agent task. Put the message back if the broker did not take it.
+// This does not preserve the order, but the message is not lost.
+// The agent task must not block, so the message is only queued here and the next drain writes it to the outbox.
+static void on_outbox_message_sent(void *user_data, const char *message, size_t message_len, int status) {
+    OutboxRetry retry;
+    (void) user_data;
+
+    if (status == EXIT_SUCCESS) {
+        return;
+    }
+    retry.len = message_len;
+    retry.data = malloc(message_len);
+    if (retry.data) {
+        memcpy(retry.data, message, message_len);
+        if (pdTRUE == xQueueSend(outbox_retry_queue, &retry, 0)) {
+            return;
+        }
+        free(retry.data);
+    }
+    outbox_retries_lost++;
+    fprintf(stderr, "Error: Unable to keep a failed message of %u bytes for the outbox\n", (unsigned int) message_len);
+}
+
+// Called from the MQTT agent task for the messages sent by the drain. The agent task must not block,
+// so the completion is only queued here, and the next drain removes the message from the outbox.
+static void on_outbox_backlog_sent(void *user_data, const char *message, size_t message_len, int status) {
+    OutboxAck ack = { (uint32_t) (uintptr_t) user_data, status };
+    (void) message;
+    (void) message_len;
+
+    if (pdTRUE != xQueueSend(outbox_ack_queue, &ack, 0)) {
+        outbox_ack_lost = true;
+    }
+}
+
+// Removes the stored messages that the broker acknowledged. If a message failed, the ones after it
+// are likely to fail too, so all unacknowledged messages are sent again, starting with the oldest one.
+// outbox_lock must be held by the caller.
+static void outbox_apply_acks_locked(void) {
+    OutboxAck ack;
+    bool rewind = outbox_ack_lost;
+
+    outbox_ack_lost = false;
+    while (pdTRUE == xQueueReceive(outbox_ack_queue, &ack, 0)) {
+        if (ack.status != EXIT_SUCCESS) {
+            rewind = true;
+        } else {
+            // Does nothing if an earlier message failed, in which case this one is sent again
+            (void) iotc_outbox_ack(&outbox, ack.id);
+        }
+    }
+    if (rewind) {
+        iotc_outbox_rewind(&outbox);
+    }
+}
+
+// Stores the messages that failed in the MQTT agent task
+static void outbox_store_retries(void) {
+    OutboxRetry retry;
+
+    while (pdTRUE == xQueueReceive(outbox_retry_queue, &retry, 0)) {
+        (void) outbox_store(retry.data, retry.len);
+        free(retry.data);
+    }
+}
+
+int iotconnect_sdk_outbox_drain(void) {
+    int ret = EXIT_SUCCESS;
+    size_t len;
+
+    if (!outbox_enabled) {
+        return EXIT_SUCCESS;
+    }
+    if (xSemaphoreTake(outbox_drain_lock, 0) != pdTRUE) {
+        return EXIT_SUCCESS; // another task is draining
+    }
+    outbox_store_retries();
+
+    TickType_t start = xTaskGetTickCount();
+    while (iotc_device_client_is_connected()) {
+        uint32_t id;
+
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        outbox_apply_acks_locked();
+        if (0 == iotc_outbox_unsent_count(&outbox)) {
+            xSemaphoreGive(outbox_lock);
+            break;
+        }
+        ret = iotc_outbox_peek_unsent(&outbox, outbox_drain_buffer, IOTC_OUTBOX_MAX_MESSAGE_SIZE, &len, &id);
+        xSemaphoreGive(outbox_lock);
+        if (ret) {
+            break;
+        }
+        outbox_drain_buffer[len] = 0;
+
+        // The messages are pipelined, up to the device client in-flight limit, so the backlog goes out at full speed.
+        // They are sent as backlog traffic, so acks and live telemetry are not held up behind them.
+        // A message stays in the outbox until its PUBACK, so that it is not lost if we reset in the meantime.
+        ret = iotc_device_client_send_message_class_len(outbox_drain_buffer, len, IOTC_QOS1, IOTC_TRAFFIC_BACKLOG,
+                                                        on_outbox_backlog_sent, (void *) (uintptr_t) id);
+        if (ret) {
+            break;
+        }
+        // A store in overwrite mode may have dropped the message while it was being sent, in which case this does nothing
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        iotc_outbox_mark_sent(&outbox, id, len);
+        xSemaphoreGive(outbox_lock);
+    }
+    outbox.stats.drain_time_total_ms += (uint32_t) ((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+
+    xSemaphoreGive(outbox_drain_lock);
+    return ret;
+}
+
+uint32_t iotconnect_sdk_outbox_count(void) {
+    uint32_t count;
+
+    if (!outbox_enabled) {
+        return 0;
+    }
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    count = iotc_outbox_count(&outbox);
+    xSemaphoreGive(outbox_lock);
+    return count;
+}
+
+void iotconnect_sdk_get_outbox_stats(IotConnectOutboxStats *stats) {
+    if (!outbox_enabled) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    *stats = outbox.stats;
+    xSemaphoreGive(outbox_lock);
+    stats->rejected += outbox_retries_lost;
+}
+
+// Stored messages need to go out first. If the backlog is not empty, queue behind it.
+static bool outbox_must_store(void) {
+    bool backlog;
+
+    if (!outbox_enabled) {
+        return false;
+    }
+    if (!iotc_device_client_is_connected()) {
+        return true;
+    }
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    backlog = iotc_outbox_count(&outbox) > 0;
+    xSemaphoreGive(outbox_lock);
+    return backlog;
+}
+
+static IotConnectDelivery telemetry_delivery(void) {
+    return config.telemetry_delivery == IOTC_DELIVERY_DEFAULT ? IOTC_DELIVERY_QOS1_RETRY : config.telemetry_delivery;
+}
+
+int iotconnect_sdk_send_packet_len(const char* data, size_t len, IotConnectDelivery delivery) {
+    switch (delivery) {
+    case IOTC_DELIVERY_QOS0:
+        if (!iotc_device_client_is_connected()) {
+            fprintf(stderr, "Error: Not connected. Dropping a QoS0 message.\n");
+            return EXIT_FAILURE;
+        }
+        return iotc_device_client_send_message_class_len(data, len, IOTC_QOS0, IOTC_TRAFFIC_LIVE, NULL, NULL);
+    case IOTC_DELIVERY_QOS1:
+        return iotc_device_client_send_message_len(data, len, IOTC_QOS1);
+    case IOTC_DELIVERY_DEFAULT:
+    case IOTC_DELIVERY_QOS1_RETRY:
+    default:
+        break;
+    }
+
+    if (!outbox_enabled) {
+        return iotc_device_client_send_message_len(data, len, IOTC_QOS1);
+    }
+
+    if (outbox_must_store()) {
+        int ret = outbox_store(data, len);
+        iotconnect_sdk_outbox_drain();
+        return ret;
+    }
+    if (iotc_device_client_send_message_len(data, len, IOTC_QOS1)) {
+        return outbox_store(data, len);
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotconnect_sdk_send_ack(const char* ack) {
+    size_t len = strlen(ack);
+
+    // Acks go out directly on the control class, ahead of any backlog. The outbox only keeps the ones that
+    // cannot be sent, and is not drained here, so that an ack never waits for the stored messages.
+    if (iotc_device_client_is_connected() && EXIT_SUCCESS == iotc_device_client_send_message_len(ack, len, IOTC_QOS1)) {
+        return EXIT_SUCCESS;
+    }
+    if (!outbox_enabled) {
+        return EXIT_FAILURE;
+    }
+    return outbox_store(ack, len);
+}
+
+int iotconnect_sdk_send_packet_ex(const char* data, IotConnectDelivery delivery) {
+    return iotconnect_sdk_send_packet_len(data, strlen(data), delivery);
+}
+
 int iotconnect_sdk_send_packet(const char* data) {
-    return iotc_device_client_send_message(data);
+    return iotconnect_sdk_send_packet_ex(data, IOTC_DELIVERY_QOS1_RETRY);
+}
+
+static uint32_t rate_interval_ms(void) {
+    if (config.rate_limit.disabled) {
+        return 0;
+    }
+    if (config.rate_limit.interval_ms) {
+        return config.rate_limit.interval_ms;
+    }
+    return iotc_sync_get_data_frequency() * 1000;
+}
+
+// Adds the credit earned since the last call, up to the burst. batch.lock must be held by the caller.
+static void rate_refill(uint32_t interval_ms) {
+    TickType_t now = xTaskGetTickCount();
+    int64_t cap = (int64_t) interval_ms * (config.rate_limit.burst ? config.rate_limit.burst : 1);
+
+    if (!rate.started) {
+        rate.credit_ms = cap; // start with a full bucket
+        rate.started = true;
+    } else {
+        rate.credit_ms += (int64_t) (now - rate.last_tick) * portTICK_PERIOD_MS;
+        if (rate.credit_ms > cap) {
+            rate.credit_ms = cap;
+        }
+    }
+    rate.last_tick = now;
+}
+
+// batch.lock must be held by the caller
+static bool rate_allows_send(void) {
+    uint32_t interval_ms = rate_interval_ms();
+
+    rate.stats.interval_ms = interval_ms;
+    if (!interval_ms) {
+        return true;
+    }
+    rate_refill(interval_ms);
+    return rate.credit_ms >= interval_ms;
+}
+
+// Charges a telemetry message. Flushes that skip the limit are charged too, so that the rate evens out later.
+// batch.lock must be held by the caller
+static void rate_charge(void) {
+    uint32_t interval_ms = rate_interval_ms();
+
+    rate.stats.sent++;
+    rate.stats.interval_ms = interval_ms;
+    if (!interval_ms) {
+        return;
+    }
+    rate_refill(interval_ms);
+    rate.credit_ms -= interval_ms;
+    int64_t floor = -(int64_t) interval_ms * (config.rate_limit.burst ? config.rate_limit.burst : 1);
+    if (rate.credit_ms < floor) {
+        rate.credit_ms = floor;
+    }
+}
+
+// Serializes the telemetry message in the format of the telemetry writer, which is CBOR with IOTC_TELEMETRY_WRITER_CBOR.
+// Free the result with telemetry_free().
+static const char *telemetry_serialize(IotclMessageHandle msg, size_t *len) {
+    const char *json = iotcl_create_serialized_string(msg, false);
+    if (!json) {
+        return NULL;
+    }
+#if IOTC_TELEMETRY_WRITER_CBOR
+    size_t size = strlen(json) + 16; // CBOR is smaller, except for a few long strings that take one more byte
+    char *buf = malloc(size);
+    const char *cbor = buf ? iotc_telemetry_writer_encode_json(buf, size, json, len) : NULL;
+    iotcl_destroy_serialized(json);
+    if (!cbor) {
+        free(buf);
+    }
+    return cbor;
+#else
+    *len = strlen(json);
+    return json;
+#endif
+}
+
+static void telemetry_free(const char *str) {
+#if IOTC_TELEMETRY_WRITER_CBOR
+    free((void *) str);
+#else
+    iotcl_destroy_serialized(str);
+#endif
+}
+
+// batch.lock must be held by the caller
+static int batch_send_locked(void) {
+    int ret;
+
+    taskENTER_CRITICAL();
+    batch.flush_requested = false;
+    taskEXIT_CRITICAL();
+    if (!batch.msg) {
+        return EXIT_SUCCESS;
+    }
+    if (0 == batch.num_points) {
+        // the first point could not be added
+        iotcl_telemetry_destroy(batch.msg);
+        batch.msg = NULL;
+        batch.held = false;
+        return EXIT_SUCCESS;
+    }
+
+    size_t len = 0;
+    const char *str = telemetry_serialize(batch.msg, &len);
+    iotcl_telemetry_destroy(batch.msg);
+    batch.msg = NULL;
+    if (!str) {
+        fprintf(stderr, "Error: Failed to serialize the telemetry batch of %u points\n", batch.num_points);
+        batch.num_points = 0;
+        batch.held = false;
+        return EXIT_FAILURE;
+    }
+
+    batch.point_size_estimate = len / batch.num_points;
+    batch.num_points = 0;
+    batch.held = false;
+    rate_charge();
+
+    // Do not wait for the PUBACK here. This can be called from the command callback
+    // and the message needs to go out before the ack without holding up the caller.
+    // Do not drain the outbox here for the same reason.
+    IotConnectDelivery delivery = telemetry_delivery();
+    if (delivery == IOTC_DELIVERY_QOS0 || delivery == IOTC_DELIVERY_QOS1) {
+        if (!iotc_device_client_is_connected()) {
+            fprintf(stderr, "Error: Not connected. Dropping the telemetry batch.\n");
+            ret = EXIT_FAILURE;
+        } else {
+            ret = iotc_device_client_send_message_class_len(str, len, delivery == IOTC_DELIVERY_QOS0 ? IOTC_QOS0 : IOTC_QOS1,
+                                                            IOTC_TRAFFIC_LIVE, NULL, NULL);
+        }
+    } else if (outbox_must_store()) {
+        ret = outbox_store(str, len);
+    } else {
+        ret = iotc_device_client_send_message_class_len(str, len, IOTC_QOS1, IOTC_TRAFFIC_LIVE,
+                                                        outbox_enabled ? on_outbox_message_sent : NULL, NULL);
+        if (ret && outbox_enabled) {
+            ret = outbox_store(str, len);
+        }
+    }
+    telemetry_free(str);
+    return ret;
+}
+
+static bool batch_limit_reached(void) {
+    const IotConnectBatchConfig *c = &config.batch;
+
+    if (0 == batch.num_points) {
+        return false;
+    }
+    if (c->max_points && batch.num_points >= c->max_points) {
+        return true;
+    }
+    if (c->max_bytes && batch.num_points * batch.point_size_estimate >= c->max_bytes) {
+        return true;
+    }
+    if (c->max_age_ms && (xTaskGetTickCount() - batch.first_point_tick) >= pdMS_TO_TICKS(c->max_age_ms)) {
+        return true;
+    }
+    if (!c->max_points && !c->max_bytes && !c->max_age_ms) {
+        return true; // batching is disabled
+    }
+    return batch.flush_requested;
+}
+
+// Sends the batch if it reached a limit and the rate limit allows it. batch.lock must be held by the caller.
+static int batch_send_if_due_locked(void) {
+    if (!batch_limit_reached()) {
+        return EXIT_SUCCESS;
+    }
+    if (!rate_allows_send()) {
+        // keep collecting points into this batch until the rate limit allows it to go out
+        if (!batch.held) {
+            batch.held = true;
+            rate.stats.deferred++;
+        }
+        return EXIT_SUCCESS;
+    }
+    return batch_send_locked();
+}
+
+IotclMessageHandle iotconnect_sdk_batch_begin_point(const char *iso_time) {
+    char now[IOTC_TIMESTAMP_LEN + 1];
+
+    if (!batch.lock) {
+        fprintf(stderr, "Error: iotconnect_sdk_batch_begin_point called before iotconnect_sdk_init\n");
+        return NULL;
+    }
+    xSemaphoreTake(batch.lock, portMAX_DELAY);
+
+    if (batch.held && batch.num_points >= IOTC_RATE_MAX_HELD_POINTS) {
+        rate.stats.dropped++;
+        fprintf(stderr, "Error: The telemetry batch is held back by the rate limit and full. Dropping the data point.\n");
+        xSemaphoreGive(batch.lock);
+        return NULL;
+    }
+
+    if (!batch.msg) {
+        batch.msg = iotcl_telemetry_create(iotconnect_sdk_get_lib_config());
+        if (!batch.msg) {
+            fprintf(stderr, "Error: Failed to create a telemetry message\n");
+            xSemaphoreGive(batch.lock);
+            return NULL;
+        }
+        batch.first_point_tick = xTaskGetTickCount();
+    }
+
+    if (!iso_time) {
+        iotc_timestamp_now(now);
+        iso_time = now;
+    }
+    if (!iotcl_telemetry_add_with_iso_time(batch.msg, iso_time)) {
+        fprintf(stderr, "Error: Failed to add a data point to the telemetry batch\n");
+        xSemaphoreGive(batch.lock);
+        return NULL;
+    }
+    batch.num_points++;
+    if (batch.held) {
+        rate.stats.coalesced++;
+    }
+
+    return batch.msg;
+}
+
+int iotconnect_sdk_batch_end_point(void) {
+    if (!batch.lock) {
+        fprintf(stderr, "Error: iotconnect_sdk_batch_end_point called before iotconnect_sdk_init\n");
+        return EXIT_FAILURE;
+    }
+    int ret = batch_send_if_due_locked();
+
+    xSemaphoreGive(batch.lock);
+    iotconnect_sdk_outbox_drain();
+    return ret;
+}
+
+int iotconnect_sdk_batch_poll(void) {
+    int ret = EXIT_SUCCESS;
+
+    if (!batch.lock) {
+        return EXIT_FAILURE;
+    }
+    xSemaphoreTake(batch.lock, portMAX_DELAY);
+    ret = batch_send_if_due_locked();
+    xSemaphoreGive(batch.lock);
+    iotconnect_sdk_outbox_drain();
+    return ret;
+}
+
+int iotconnect_sdk_batch_flush(void) {
+    int ret;
+
+    if (!batch.lock) {
+        return EXIT_FAILURE;
+    }
+    xSemaphoreTake(batch.lock, portMAX_DELAY);
+    ret = batch_send_locked();
+    xSemaphoreGive(batch.lock);
+    return ret;
+}
+
+int iotconnect_sdk_batch_report_attributes(IotConnectAttributeTable *table) {
+    uint32_t now_ms = (uint32_t) (xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+    if (!iotc_attributes_due(table, now_ms)) {
+        return EXIT_SUCCESS;
+    }
+    IotclMessageHandle msg = iotconnect_sdk_batch_begin_point(NULL);
+    if (!msg) {
+        return EXIT_FAILURE;
+    }
+    (void) iotc_attributes_emit(table, msg, now_ms);
+    return iotconnect_sdk_batch_end_point();
+}
+
+int iotconnect_sdk_batch_report_aggregates(IotConnectAggregator *aggregator) {
+    uint32_t now_ms = (uint32_t) (xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+    if (!iotc_aggregator_due(aggregator, now_ms)) {
+        return EXIT_SUCCESS;
+    }
+    if (!iotc_aggregator_has_samples(aggregator)) {
+        // move on to the next window without sending an empty data point
+        (void) iotc_aggregator_emit(aggregator, NULL, now_ms);
+        return EXIT_SUCCESS;
+    }
+    IotclMessageHandle msg = iotconnect_sdk_batch_begin_point(NULL);
+    if (!msg) {
+        return EXIT_FAILURE;
+    }
+    (void) iotc_aggregator_emit(aggregator, msg, now_ms);
+    return iotconnect_sdk_batch_end_point();
+}
+
+void iotconnect_sdk_get_rate_stats(IotConnectRateStats *stats) {
+    if (!batch.lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(batch.lock, portMAX_DELAY);
+    *stats = rate.stats;
+    xSemaphoreGive(batch.lock);
+}
+
+int iotconnect_sdk_send_metrics_report(void) {
+    IotConnectMetricsSnapshot snapshot;
+    char name[32];
+    char now[IOTC_TIMESTAMP_LEN + 1];
+
+    iotc_metrics_snapshot(&snapshot);
+
+    IotclMessageHandle msg = iotcl_telemetry_create(iotconnect_sdk_get_lib_config());
+    iotc_timestamp_now(now);
+    if (!msg || !iotcl_telemetry_add_with_iso_time(msg, now)) {
+        fprintf(stderr, "Error: Failed to create the metrics report\n");
+        if (msg) {
+            iotcl_telemetry_destroy(msg);
+        }
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < IOTC_METRIC_COUNT; i++) {
+        const IotConnectMetric *m = &snapshot.metrics[i];
+        const char *metric = iotc_metrics_name((IotConnectMetricId) i);
+        snprintf(name, sizeof(name), "%s_n", metric);
+        iotcl_telemetry_set_number(msg, name, m->latency_ms.count);
+        snprintf(name, sizeof(name), "%s_p50", metric);
+        iotcl_telemetry_set_number(msg, name, iotc_histogram_percentile(&m->latency_ms, 50));
+        snprintf(name, sizeof(name), "%s_p95", metric);
+        iotcl_telemetry_set_number(msg, name, iotc_histogram_percentile(&m->latency_ms, 95));
+        snprintf(name, sizeof(name), "%s_max", metric);
+        iotcl_telemetry_set_number(msg, name, m->latency_ms.max);
+        snprintf(name, sizeof(name), "%s_fail", metric);
+        iotcl_telemetry_set_number(msg, name, m->failures);
+    }
+    for (int i = 0; i < iotc_sampler_count(); i++) {
+        IotConnectSamplerStats stats;
+        const char *sampler = iotc_sampler_name(i);
+        iotc_sampler_get_stats(i, &stats);
+        snprintf(name, sizeof(name), "%s_jitter_p95", sampler);
+        iotcl_telemetry_set_number(msg, name, iotc_histogram_percentile(&stats.jitter_ms, 95));
+        snprintf(name, sizeof(name), "%s_jitter_max", sampler);
+        iotcl_telemetry_set_number(msg, name, stats.jitter_ms.max);
+        snprintf(name, sizeof(name), "%s_missed", sampler);
+        iotcl_telemetry_set_number(msg, name, stats.missed);
+        snprintf(name, sizeof(name), "%s_dropped", sampler);
+        iotcl_telemetry_set_number(msg, name, stats.dropped);
+    }
+    if (iotc_sampler_count() > 0) {
+        IotConnectSampleRingStats ring_stats;
+        iotc_sampler_get_ring_stats(&ring_stats);
+        iotcl_telemetry_set_number(msg, "sampler_ring_hw", ring_stats.high_water);
+    }
+
+    size_t len = 0;
+    const char *str = telemetry_serialize(msg, &len);
+    iotcl_telemetry_destroy(msg);
+    if (!str) {
+        fprintf(stderr, "Error: Failed to serialize the metrics report\n");
+        return EXIT_FAILURE;
+    }
+    int ret = iotconnect_sdk_send_packet_len(str, len, IOTC_DELIVERY_QOS0);
+    telemetry_free(str);
+    return ret;
+}
+
+// Send the pending telemetry ahead of an ack, but never wait on the application
+// that may be in the middle of populating a data point.
+static void batch_flush_before_ack(void) {
+    if (!batch.lock) {
+        return;
+    }
+    if (xSemaphoreTake(batch.lock, 0) == pdTRUE) {
+        (void) batch_send_locked();
+        xSemaphoreGive(batch.lock);
+    } else {
+        // the application holds batch.lock, so the flag is set in a critical section instead
+        taskENTER_CRITICAL();
+        batch.flush_requested = true;
+        taskEXIT_CRITICAL();
+    }
+}
+
+static uint32_t command_hash(const char *name, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t) name[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+static int command_register(const char *name, IotConnectCommandHandler handler, void *user_data, uint32_t timeout_ms) {
+    size_t len = name ? strlen(name) : 0;
+    if (!len || !handler) {
+        fprintf(stderr, "Error: A command name and handler are required\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t hash = command_hash(name, len);
+    for (unsigned int i = 0; i < IOTC_COMMAND_TABLE_SIZE; i++) {
+        CommandEntry *e = &command_table[(hash + i) & (IOTC_COMMAND_TABLE_SIZE - 1)];
+        if (e->name && e->hash == hash && e->name_len == len && 0 == memcmp(e->name, name, len)) {
+            num_async_commands -= e->timeout_ms ? 1 : 0;
+            num_async_commands += timeout_ms ? 1 : 0;
+            e->handler = handler; // replace the existing handler
+            e->user_data = user_data;
+            e->timeout_ms = timeout_ms;
+            return EXIT_SUCCESS;
+        }
+        if (!e->name) {
+            if (num_commands >= IOTC_COMMAND_TABLE_SIZE * 3 / 4) {
+                break; // keep the probe sequences short
+            }
+            e->name = name;
+            e->name_len = len;
+            e->hash = hash;
+            e->handler = handler;
+            e->user_data = user_data;
+            e->timeout_ms = timeout_ms;
+            num_commands++;
+            num_async_commands += timeout_ms ? 1 : 0;
+            return EXIT_SUCCESS;
+        }
+    }
+    fprintf(stderr, "Error: Cannot register command %s. Increase IOTC_COMMAND_TABLE_SIZE.\n", name);
+    return EXIT_FAILURE;
+}
+
+int iotconnect_sdk_register_command(const char *name, IotConnectCommandHandler handler, void *user_data) {
+    return command_register(name, handler, user_data, 0);
+}
+
+int iotconnect_sdk_register_async_command(const char *name, IotConnectCommandHandler handler, void *user_data, uint32_t timeout_ms) {
+    if (0 == timeout_ms) {
+        fprintf(stderr, "Error: Async command %s needs a timeout\n", name ? name : "");
+        return EXIT_FAILURE;
+    }
+    return command_register(name, handler, user_data, timeout_ms);
+}
+
+static const CommandEntry *command_find(const IotConnectStringView *name) {
+    uint32_t hash = command_hash(name->data, name->len);
+    for (unsigned int i = 0; i < IOTC_COMMAND_TABLE_SIZE; i++) {
+        const CommandEntry *e = &command_table[(hash + i) & (IOTC_COMMAND_TABLE_SIZE - 1)];
+        if (!e->name) {
+            return NULL;
+        }
+        if (e->hash == hash && e->name_len == name->len && 0 == memcmp(e->name, name->data, name->len)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Splits the command into views of its space separated words. Nothing is copied.
+static int command_tokenize(const IotConnectStringView *command, IotConnectStringView *argv) {
+    const char *p = command->data;
+    const char *end = command->data + command->len;
+    int argc = 0;
+
+    while (argc < IOTC_COMMAND_MAX_ARGS) {
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        argv[argc].data = p;
+        if (argc == IOTC_COMMAND_MAX_ARGS - 1) {
+            p = end; // the rest of the line
+            while (p[-1] == ' ') {
+                p--;
+            }
+        } else {
+            while (p < end && *p != ' ') {
+                p++;
+            }
+        }
+        argv[argc].len = (size_t) (p - argv[argc].data);
+        argc++;
+    }
+    return argc;
+}
+
+static void command_send_ack(IotclEventData data, bool success, const char *message) {
+    const char *ack = iotcl_create_ack_string_and_destroy_event(data, success, message);
+    if (NULL != ack) {
+        if (iotconnect_sdk_send_ack(ack)) {
+            fprintf(stderr, "Error: Failed to send the command ack\n");
+        }
+        free((void *) ack);
+    }
+}
+
+static uint32_t ticks_to_ms(TickType_t ticks) {
+    return (uint32_t) (ticks * portTICK_PERIOD_MS);
+}
+
+// Hands the command over to the workers. The ack is sent once the handler returns or the timeout passes.
+static void command_submit(IotclEventData data, const CommandEntry *e, const IotConnectStringView *command) {
+    CommandJob *job = NULL;
+
+    if (command->len > IOTC_COMMAND_MAX_LEN) {
+        command_send_ack(data, false, "Command is too long");
+        return;
+    }
+
+    xSemaphoreTake(command_lock, portMAX_DELAY);
+    for (size_t i = 0; i < IOTC_COMMAND_MAX_PENDING; i++) {
+        if (JOB_FREE == command_jobs[i].state) {
+            job = &command_jobs[i];
+            job->state = JOB_QUEUED;
+            job->data = data;
+            job->entry = e;
+            memcpy(job->command, command->data, command->len);
+            job->command_len = command->len;
+            job->submitted = xTaskGetTickCount();
+            break;
+        }
+    }
+    if (job) {
+        command_stats.submitted++;
+    } else {
+        command_stats.rejected++;
+    }
+    xSemaphoreGive(command_lock);
+
+    if (!job) {
+        fprintf(stderr, "Error: Too many pending commands. Rejecting %.*s\n", (int) e->name_len, e->name);
+        command_send_ack(data, false, "Too many pending commands");
+        return;
+    }
+    // The queue has room for all jobs, so this cannot fail
+    (void) xQueueSend(command_queue, &job, 0);
+    xTaskNotifyGive(command_timeout_task_handle);
+}
+
+static void command_worker_task(void *pvParameters) {
+    CommandJob *job;
+    IotConnectStringView argv[IOTC_COMMAND_MAX_ARGS];
+    (void) pvParameters;
+
+    for (;;) {
+        if (pdTRUE != xQueueReceive(command_queue, &job, portMAX_DELAY)) {
+            continue;
+        }
+
+        xSemaphoreTake(command_lock, portMAX_DELAY);
+        bool run = (JOB_QUEUED == job->state);
+        if (run) {
+            job->state = JOB_RUNNING;
+            iotc_histogram_add(&command_stats.queue_time_ms, ticks_to_ms(xTaskGetTickCount() - job->submitted));
+        }
+        xSemaphoreGive(command_lock);
+
+        bool success = false;
+        const char *message = NULL;
+        TickType_t start = xTaskGetTickCount();
+        if (run) {
+            IotConnectStringView line = {job->command, job->command_len};
+            int argc = command_tokenize(&line, argv);
+            success = job->entry->handler(job->entry->user_data, argc, argv, &message);
+        } // else it timed out while waiting in the queue
+
+        IotclEventData data = NULL;
+        xSemaphoreTake(command_lock, portMAX_DELAY);
+        if (run) {
+            iotc_histogram_add(&command_stats.run_time_ms, ticks_to_ms(xTaskGetTickCount() - start));
+        }
+        if (JOB_RUNNING == job->state) {
+            data = job->data;
+            command_stats.completed++;
+        }
+        job->data = NULL;
+        job->state = JOB_FREE;
+        xSemaphoreGive(command_lock);
+
+        if (data) {
+            command_send_ack(data, success, message);
+        }
+    }
+}
+
+// Sends the failure acks for the commands that are past their deadline. This runs in its own task,
+// rather than in the timer task, because sending an ack can block until the PUBACK.
+static void command_timeout_task(void *pvParameters) {
+    IotclEventData expired[IOTC_COMMAND_MAX_PENDING];
+    bool pending = false;
+    (void) pvParameters;
+
+    for (;;) {
+        // Each submit wakes this up for an early check, so a stream of commands cannot postpone the deadlines
+        (void) ulTaskNotifyTake(pdTRUE, pending ? pdMS_TO_TICKS(IOTC_COMMAND_TIMEOUT_CHECK_MS) : portMAX_DELAY);
+
+        size_t num_expired = 0;
+        TickType_t now = xTaskGetTickCount();
+        pending = false;
+        xSemaphoreTake(command_lock, portMAX_DELAY);
+        for (size_t i = 0; i < IOTC_COMMAND_MAX_PENDING; i++) {
+            CommandJob *job = &command_jobs[i];
+            if (JOB_QUEUED != job->state && JOB_RUNNING != job->state) {
+                continue;
+            }
+            if ((now - job->submitted) >= pdMS_TO_TICKS(job->entry->timeout_ms)) {
+                expired[num_expired++] = job->data;
+                job->data = NULL;
+                job->state = JOB_TIMED_OUT;
+                command_stats.timed_out++;
+            } else {
+                pending = true;
+            }
+        }
+        xSemaphoreGive(command_lock);
+
+        for (size_t i = 0; i < num_expired; i++) {
+            command_send_ack(expired[i], false, "Timed out");
+        }
+    }
+}
+
+static int command_executor_init(void) {
+    if (command_queue || 0 == num_async_commands) {
+        return EXIT_SUCCESS;
+    }
+    command_lock = xSemaphoreCreateMutexStatic(&command_lock_storage);
+    command_queue = xQueueCreateStatic(IOTC_COMMAND_MAX_PENDING, sizeof(CommandJob *), command_queue_storage, &command_queue_struct);
+    if (pdPASS != xTaskCreate(command_timeout_task, "IoTC-CmdTmo", IOTC_COMMAND_TIMEOUT_STACK_SIZE, NULL,
+                              IOTC_COMMAND_WORKER_PRIORITY, &command_timeout_task_handle)) {
+        fprintf(stderr, "Error: Failed to create the command timeout task\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < IOTC_COMMAND_WORKERS; i++) {
+        if (pdPASS != xTaskCreate(command_worker_task, "IoTC-Cmd", IOTC_COMMAND_WORKER_STACK_SIZE, NULL,
+                                  IOTC_COMMAND_WORKER_PRIORITY, NULL)) {
+            fprintf(stderr, "Error: Failed to create the command worker task\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+void iotconnect_sdk_get_command_stats(IotConnectCommandStats *stats) {
+    if (!command_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(command_lock, portMAX_DELAY);
+    *stats = command_stats;
+    xSemaphoreGive(command_lock);
+}
+
+// Returns true if a registered handler took the command, in which case the event is acked and destroyed.
+static bool command_dispatch(IotclEventData data) {
+    IotConnectStringView command;
+    IotConnectStringView argv[IOTC_COMMAND_MAX_ARGS];
+
+    if (0 == num_commands || EXIT_SUCCESS != iotconnect_sdk_event_get_command(&command)) {
+        return false;
+    }
+    int argc = command_tokenize(&command, argv);
+    if (0 == argc) {
+        return false;
+    }
+    const CommandEntry *e = command_find(&argv[0]);
+    if (!e) {
+        return false;
+    }
+    if (e->timeout_ms && command_queue) { // runs inline if it was registered after iotconnect_sdk_init()
+        command_submit(data, e, &command);
+        return true;
+    }
+
+    const char *message = NULL;
+    bool success = e->handler(e->user_data, argc, argv, &message);
+    command_send_ack(data, success, message);
+    return true;
+}
+
+static void on_command_intercept(IotclEventData data) {
+    batch_flush_before_ack();
+    if (command_dispatch(data)) {
+        return;
+    }
+    if (NULL != config.cmd_cb) {
+        config.cmd_cb(data);
+    } else {
+        command_send_ack(data, false, "Unknown command");
+    }
+}
+
+static void on_ota_intercept(IotclEventData data) {
+    batch_flush_before_ack();
+    if (NULL != config.ota_cb) {
+        config.ota_cb(data);
+    }
 }
 
 
@@ -111,11 +1270,15 @@ int iotconnect_sdk_init() {
         return -1;
     }
 
-    lib_config.event_functions.ota_cb = config.ota_cb;
-    lib_config.event_functions.cmd_cb = config.cmd_cb;
+    lib_config.event_functions.ota_cb = config.ota_cb ? on_ota_intercept : NULL;
+    lib_config.event_functions.cmd_cb = (config.cmd_cb || num_commands) ? on_command_intercept : NULL;
     lib_config.event_functions.msg_cb = on_message_intercept;
 
     lib_config.telemetry.dtg = iotc_sync_get_dtg();
+    if (!lib_config.telemetry.dtg) {
+        fprintf(stderr, "Error: The sync has not completed. Call iotc_sync_obtain_response() first.\n");
+        return -1;
+    }
 
     char cpid_buff[5];
     strncpy(cpid_buff, config.cpid, 4);
@@ -128,6 +1291,35 @@ int iotconnect_sdk_init() {
         return -1;
     }
 
+    if (!batch.lock) {
+        batch.lock = xSemaphoreCreateMutex();
+        if (!batch.lock) {
+            fprintf(stderr, "Error: Failed to create the telemetry batch lock\n");
+            return -1;
+        }
+    }
+    batch.point_size_estimate = IOTC_BATCH_INITIAL_POINT_SIZE;
+
+    if (config.outbox_storage && !outbox_enabled) {
+        outbox_lock = xSemaphoreCreateMutex();
+        outbox_drain_lock = xSemaphoreCreateMutex();
+        outbox_retry_queue = xQueueCreateStatic(IOTC_OUTBOX_RETRY_QUEUE_LEN, sizeof(OutboxRetry), outbox_retry_queue_storage, &outbox_retry_queue_struct);
+        outbox_ack_queue = xQueueCreateStatic(IOTC_OUTBOX_ACK_QUEUE_LEN, sizeof(OutboxAck), outbox_ack_queue_storage, &outbox_ack_queue_struct);
+        if (!outbox_lock || !outbox_drain_lock) {
+            fprintf(stderr, "Error: Failed to create the outbox locks\n");
+            return -1;
+        }
+        if (iotc_outbox_init(&outbox, config.outbox_storage, config.outbox_header_storage, config.outbox_overwrite_oldest)) {
+            fprintf(stderr, "Error: Failed to initialize the outbox\n");
+            return -1;
+        }
+        outbox_enabled = true;
+    }
+
+    if (command_executor_init()) {
+        return -1;
+    }
+
     IotConnectDeviceClientConfig pc;
 
     pc.c2d_msg_cb = on_mqtt_c2d_message;
@@ -0,0 +1,180 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_aggregate.h"
+
+// Longest attribute name that can be reported. Longer names are truncated.
+#define AGGREGATE_NAME_MAX_LEN 48
+
+static void stats_reset(IotConnectWindowStats *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void iotc_aggregator_init(IotConnectAggregator *a, const IotConnectAggregateAttribute *attrs, size_t num_attrs,
+                          IotConnectWindowStats *storage, uint32_t window_ms, unsigned int sub_windows) {
+    memset(a, 0, sizeof(*a));
+    a->attrs = attrs;
+    a->num_attrs = num_attrs;
+    a->stats = storage;
+    a->sub_windows = sub_windows ? sub_windows : 1;
+    a->sub_window_ms = window_ms / a->sub_windows;
+    for (size_t i = 0; i < num_attrs * a->sub_windows; i++) {
+        stats_reset(&storage[i]);
+    }
+}
+
+static unsigned int bin_index(const IotConnectAggregateAttribute *attr, double value) {
+    double width = (attr->range_max - attr->range_min) / IOTC_AGGREGATE_BINS;
+    if (!(width > 0) || !(value > attr->range_min)) { // also catches NaN
+        return 0;
+    }
+    double index = (value - attr->range_min) / width;
+    return index >= IOTC_AGGREGATE_BINS ? IOTC_AGGREGATE_BINS - 1 : (unsigned int) index;
+}
+
+void iotc_aggregator_add(IotConnectAggregator *a, size_t index, double value) {
+    if (index >= a->num_attrs || isnan(value)) {
+        return;
+    }
+    IotConnectWindowStats *s = &a->stats[index * a->sub_windows + a->current];
+    double delta = value - s->mean;
+
+    s->count++;
+    s->mean += delta / s->count;
+    s->m2 += delta * (value - s->mean);
+    if (1 == s->count || value < s->min) {
+        s->min = value;
+    }
+    if (1 == s->count || value > s->max) {
+        s->max = value;
+    }
+    s->bins[bin_index(&a->attrs[index], value)]++;
+}
+
+// Chan's method for combining the running mean and variance of two sets of samples
+static void stats_merge(IotConnectWindowStats *into, const IotConnectWindowStats *s) {
+    if (0 == s->count) {
+        return;
+    }
+    if (0 == into->count) {
+        *into = *s;
+        return;
+    }
+    uint32_t n = into->count + s->count;
+    double delta = s->mean - into->mean;
+    into->mean += delta * s->count / n;
+    into->m2 += s->m2 + delta * delta * ((double) into->count * s->count / n);
+    into->count = n;
+    if (s->min < into->min) {
+        into->min = s->min;
+    }
+    if (s->max > into->max) {
+        into->max = s->max;
+    }
+    for (unsigned int i = 0; i < IOTC_AGGREGATE_BINS; i++) {
+        into->bins[i] += s->bins[i];
+    }
+}
+
+// Interpolates within the bin that holds the percentile, and clamps to the values seen
+static double stats_percentile(const IotConnectAggregateAttribute *attr, const IotConnectWindowStats *s, unsigned int percentile) {
+    double rank = (double) s->count * percentile / 100.0;
+    double width = (attr->range_max - attr->range_min) / IOTC_AGGREGATE_BINS;
+    uint32_t below = 0;
+    double value = s->max;
+
+    for (unsigned int i = 0; i < IOTC_AGGREGATE_BINS; i++) {
+        if (s->bins[i] && below + s->bins[i] >= rank) {
+            value = attr->range_min + width * (i + (rank - below) / s->bins[i]);
+            break;
+        }
+        below += s->bins[i];
+    }
+    if (value < s->min) {
+        return s->min;
+    }
+    return value > s->max ? s->max : value;
+}
+
+bool iotc_aggregator_due(IotConnectAggregator *a, uint32_t now_ms) {
+    if (!a->started) {
+        a->started = true;
+        a->sub_window_end_ms = now_ms + a->sub_window_ms;
+        return false;
+    }
+    return (int32_t) (now_ms - a->sub_window_end_ms) >= 0;
+}
+
+bool iotc_aggregator_has_samples(const IotConnectAggregator *a) {
+    for (size_t i = 0; i < a->num_attrs * a->sub_windows; i++) {
+        if (a->stats[i].count) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool set_summary(IotclMessageHandle msg, const char *name, const char *suffix, double value) {
+    char key[AGGREGATE_NAME_MAX_LEN + 8];
+    snprintf(key, sizeof(key), "%.*s_%s", AGGREGATE_NAME_MAX_LEN, name, suffix);
+    return iotcl_telemetry_set_number(msg, key, value);
+}
+
+size_t iotc_aggregator_emit(IotConnectAggregator *a, IotclMessageHandle msg, uint32_t now_ms) {
+    size_t num_set = 0;
+
+    for (size_t i = 0; i < a->num_attrs; i++) {
+        const IotConnectAggregateAttribute *attr = &a->attrs[i];
+        unsigned int outputs = attr->outputs ? attr->outputs : IOTC_AGGREGATE_ALL;
+        IotConnectWindowStats window;
+
+        stats_reset(&window);
+        for (unsigned int w = 0; w < a->sub_windows; w++) {
+            stats_merge(&window, &a->stats[i * a->sub_windows + w]);
+        }
+        if (0 == window.count) {
+            continue;
+        }
+
+        if (outputs & IOTC_AGGREGATE_COUNT) {
+            num_set += set_summary(msg, attr->name, "n", window.count);
+        }
+        if (outputs & IOTC_AGGREGATE_MIN) {
+            num_set += set_summary(msg, attr->name, "min", window.min);
+        }
+        if (outputs & IOTC_AGGREGATE_MAX) {
+            num_set += set_summary(msg, attr->name, "max", window.max);
+        }
+        if (outputs & IOTC_AGGREGATE_MEAN) {
+            num_set += set_summary(msg, attr->name, "mean", window.mean);
+        }
+        if (outputs & IOTC_AGGREGATE_STDDEV) {
+            num_set += set_summary(msg, attr->name, "std", window.count > 1 ? sqrt(window.m2 / (window.count - 1)) : 0);
+        }
+        if (outputs & IOTC_AGGREGATE_P50) {
+            num_set += set_summary(msg, attr->name, "p50", stats_percentile(attr, &window, 50));
+        }
+        if (outputs & IOTC_AGGREGATE_P90) {
+            num_set += set_summary(msg, attr->name, "p90", stats_percentile(attr, &window, 90));
+        }
+        if (outputs & IOTC_AGGREGATE_P99) {
+            num_set += set_summary(msg, attr->name, "p99", stats_percentile(attr, &window, 99));
+        }
+    }
+
+    // the oldest sub-window drops out of the sliding window and collects the next samples
+    a->current = (a->current + 1) % a->sub_windows;
+    for (size_t i = 0; i < a->num_attrs; i++) {
+        stats_reset(&a->stats[i * a->sub_windows + a->current]);
+    }
+    a->sub_window_end_ms += a->sub_window_ms;
+    if ((int32_t) (now_ms - a->sub_window_end_ms) >= 0) {
+        a->sub_window_end_ms = now_ms + a->sub_window_ms; // fell behind. Do not emit the missed windows.
+    }
+    return num_set;
+}
@@ -0,0 +1,139 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "iotconnect_attributes.h"
+
+void iotc_attributes_init(IotConnectAttributeTable *t, IotConnectAttribute *attrs, const IotConnectAttributeConfig *configs, size_t num_attrs) {
+    memset(t, 0, sizeof(*t));
+    memset(attrs, 0, sizeof(*attrs) * num_attrs);
+    for (size_t i = 0; i < num_attrs; i++) {
+        attrs[i].config = &configs[i];
+    }
+    t->attrs = attrs;
+    t->num_attrs = num_attrs;
+}
+
+static IotConnectAttribute *attribute_write(IotConnectAttributeTable *t, size_t index, IotConnectAttributeType type) {
+    if (index >= t->num_attrs || t->attrs[index].config->type != type) {
+        return NULL;
+    }
+    t->stats.writes++;
+    t->attrs[index].has_value = true;
+    return &t->attrs[index];
+}
+
+// Once due, the value stays due until it is reported, and the latest value is the one that is reported
+static bool attribute_update_due(IotConnectAttributeTable *t, IotConnectAttribute *a, bool changed) {
+    if (!a->has_reported) {
+        changed = true;
+    }
+    if (changed && !a->due) {
+        a->due = true;
+        t->num_due++;
+    }
+    return a->due;
+}
+
+static bool number_changed(const IotConnectAttribute *a, double value) {
+    double last = a->reported_number;
+    if (isnan(value) || isnan(last)) {
+        return isnan(value) != isnan(last);
+    }
+    double band = a->config->deadband;
+    double percent_band = fabs(last) * a->config->deadband_percent / 100.0;
+    if (percent_band > band) {
+        band = percent_band;
+    }
+    return band > 0 ? fabs(value - last) > band : value != last;
+}
+
+bool iotc_attributes_set_number(IotConnectAttributeTable *t, size_t index, double value) {
+    IotConnectAttribute *a = attribute_write(t, index, IOTC_ATTRIBUTE_NUMBER);
+    if (!a) {
+        return false;
+    }
+    a->number = value;
+    return attribute_update_due(t, a, number_changed(a, value));
+}
+
+bool iotc_attributes_set_bool(IotConnectAttributeTable *t, size_t index, bool value) {
+    IotConnectAttribute *a = attribute_write(t, index, IOTC_ATTRIBUTE_BOOL);
+    if (!a) {
+        return false;
+    }
+    a->number = value ? 1 : 0;
+    return attribute_update_due(t, a, a->number != a->reported_number);
+}
+
+bool iotc_attributes_set_string(IotConnectAttributeTable *t, size_t index, const char *value) {
+    IotConnectAttribute *a = attribute_write(t, index, IOTC_ATTRIBUTE_STRING);
+    if (!a || !value) {
+        return false;
+    }
+    strncpy(a->string, value, IOTC_ATTRIBUTE_MAX_STRING_LEN);
+    a->string[IOTC_ATTRIBUTE_MAX_STRING_LEN] = 0;
+    return attribute_update_due(t, a, 0 != strcmp(a->string, a->reported_string));
+}
+
+static bool attribute_silent_too_long(const IotConnectAttribute *a, uint32_t now_ms) {
+    return a->has_value && a->config->max_silence_ms && (uint32_t) (now_ms - a->last_report_ms) >= a->config->max_silence_ms;
+}
+
+bool iotc_attributes_due(const IotConnectAttributeTable *t, uint32_t now_ms) {
+    if (t->num_due > 0) {
+        return true;
+    }
+    for (size_t i = 0; i < t->num_attrs; i++) {
+        if (attribute_silent_too_long(&t->attrs[i], now_ms)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t iotc_attributes_emit(IotConnectAttributeTable *t, IotclMessageHandle msg, uint32_t now_ms) {
+    size_t num_set = 0;
+
+    for (size_t i = 0; i < t->num_attrs; i++) {
+        IotConnectAttribute *a = &t->attrs[i];
+        bool ok;
+        if (!a->due && !attribute_silent_too_long(a, now_ms)) {
+            continue;
+        }
+        switch (a->config->type) {
+            case IOTC_ATTRIBUTE_BOOL:
+                ok = iotcl_telemetry_set_bool(msg, a->config->name, a->number != 0);
+                break;
+            case IOTC_ATTRIBUTE_STRING:
+                ok = iotcl_telemetry_set_string(msg, a->config->name, a->string);
+                break;
+            case IOTC_ATTRIBUTE_NUMBER:
+            default:
+                ok = iotcl_telemetry_set_number(msg, a->config->name, a->number);
+                break;
+        }
+        if (!ok) {
+            continue; // stays due and is tried again with the next data point
+        }
+        a->reported_number = a->number;
+        if (IOTC_ATTRIBUTE_STRING == a->config->type) {
+            strcpy(a->reported_string, a->string);
+        }
+        a->has_reported = true;
+        a->last_report_ms = now_ms;
+        if (a->due) {
+            a->due = false;
+            t->num_due--;
+        }
+        num_set++;
+    }
+    t->stats.reported += (uint32_t) num_set;
+    if (num_set) {
+        t->stats.points++;
+    }
+    return num_set;
+}
@@ -0,0 +1,44 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include "iotconnect_histogram.h"
+
+static unsigned int bucket_index(uint32_t value) {
+    unsigned int index = 0;
+    while (value) {
+        value >>= 1;
+        index++;
+    }
+    return index < IOTC_HISTOGRAM_BUCKETS ? index : IOTC_HISTOGRAM_BUCKETS - 1;
+}
+
+void iotc_histogram_add(IotConnectHistogram *h, uint32_t value) {
+    h->buckets[bucket_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+uint32_t iotc_histogram_percentile(const IotConnectHistogram *h, unsigned int percentile) {
+    if (0 == h->count) {
+        return 0;
+    }
+    // rank of the value we are looking for, rounded up, counting from 1
+    uint64_t rank = ((uint64_t) h->count * (percentile > 100 ? 100 : percentile) + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < IOTC_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint32_t top = i ? (uint32_t) ((1ULL << i) - 1) : 0;
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
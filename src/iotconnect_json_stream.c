@@ -0,0 +1,276 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_json_stream.h"
+
+enum {
+    ST_VALUE, // expecting a value
+    ST_VALUE_OR_END, // first element of an array, or the closing bracket
+    ST_KEY_OR_END, // first key of an object, or the closing brace
+    ST_KEY_START, // key after a comma
+    ST_KEY,
+    ST_COLON,
+    ST_STRING_VALUE,
+    ST_LITERAL,
+    ST_AFTER_VALUE, // comma or closing bracket/brace
+    ST_DONE
+};
+
+static bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void path_truncate(IotConnectJsonStream *js, unsigned int len) {
+    js->path_len = len;
+    js->path[len] = 0;
+    js->path_overflow = false;
+}
+
+static void path_append(IotConnectJsonStream *js, const char *str, size_t len) {
+    if (js->path_len + len > IOTC_JSON_STREAM_MAX_PATH_LEN) {
+        js->path_overflow = true; // no path can match
+        return;
+    }
+    memcpy(&js->path[js->path_len], str, len);
+    js->path_len += (unsigned int) len;
+    js->path[js->path_len] = 0;
+}
+
+// sets the path to the container path plus the current array index
+static void path_set_index(IotConnectJsonStream *js) {
+    char index_str[12];
+    unsigned int parent_len = js->stack[js->depth - 1].path_len;
+    path_truncate(js, parent_len);
+    int len = snprintf(index_str, sizeof(index_str), "%s%u", parent_len ? "." : "", js->stack[js->depth - 1].index);
+    path_append(js, index_str, (size_t) len);
+}
+
+static bool push(IotConnectJsonStream *js, bool is_array) {
+    if (js->depth >= IOTC_JSON_STREAM_MAX_DEPTH) {
+        js->error = true;
+        return false;
+    }
+    js->stack[js->depth].is_array = is_array;
+    js->stack[js->depth].index = 0;
+    js->stack[js->depth].path_len = js->path_len;
+    js->depth++;
+    return true;
+}
+
+static bool pop(IotConnectJsonStream *js, char c) {
+    if (js->depth == 0 || js->stack[js->depth - 1].is_array != (c == ']')) {
+        js->error = true;
+        return false;
+    }
+    js->depth--;
+    path_truncate(js, js->stack[js->depth].path_len);
+    js->state = (js->depth == 0) ? ST_DONE : ST_AFTER_VALUE;
+    js->done = (js->depth == 0);
+    return true;
+}
+
+static void value_begin(IotConnectJsonStream *js, const char *start) {
+    js->match = -1;
+    js->value_start = start;
+    js->value_len = 0;
+    js->value_truncated = false;
+    if (js->path_overflow) {
+        return;
+    }
+    for (size_t i = 0; i < js->num_paths; i++) {
+        if (0 == strcmp(js->paths[i], js->path)) {
+            js->match = (int) i;
+            break;
+        }
+    }
+}
+
+static void value_buffer(IotConnectJsonStream *js, const char *data, size_t len) {
+    size_t room = IOTC_JSON_STREAM_MAX_VALUE_LEN - js->value_len;
+    if (len > room) {
+        len = room;
+        js->value_truncated = true;
+    }
+    memcpy(&js->value_buf[js->value_len], data, len);
+    js->value_len += len;
+}
+
+// end points just past the last character of the value in the chunk that starts at chunk
+static bool value_end(IotConnectJsonStream *js, const char *chunk, const char *end, bool is_string) {
+    bool ret = true;
+
+    if (js->match >= 0) {
+        if (js->value_start) {
+            ret = js->cb(js->user_data, (size_t) js->match, js->value_start, (size_t) (end - js->value_start), is_string);
+        } else {
+            value_buffer(js, chunk, (size_t) (end - chunk));
+            if (js->value_truncated) {
+                // a partial value, like a truncated host name, is worse than no value
+                fprintf(stderr, "Error: JSON value at %s is longer than %d bytes\n", js->path, IOTC_JSON_STREAM_MAX_VALUE_LEN);
+                js->error = true;
+                return false;
+            }
+            ret = js->cb(js->user_data, (size_t) js->match, js->value_buf, js->value_len, is_string);
+        }
+    }
+    js->match = -1;
+    js->value_start = NULL;
+    js->state = (js->depth == 0) ? ST_DONE : ST_AFTER_VALUE;
+    js->done = (js->depth == 0);
+    return ret;
+}
+
+void iotc_json_stream_init(IotConnectJsonStream *js, const char *const *paths, size_t num_paths,
+                           IotConnectJsonValueCallback cb, void *user_data) {
+    memset(js, 0, sizeof(*js));
+    js->paths = paths;
+    js->num_paths = num_paths;
+    js->cb = cb;
+    js->user_data = user_data;
+    js->state = ST_VALUE;
+    js->match = -1;
+}
+
+bool iotc_json_stream_feed(IotConnectJsonStream *js, const char *data, size_t len) {
+    const char *p = data;
+    const char *end = data + len;
+
+    if (js->error) {
+        return false;
+    }
+
+    while (p < end && !js->error) {
+        char c = *p;
+        switch (js->state) {
+            case ST_VALUE_OR_END:
+                if (c == ']') {
+                    pop(js, c);
+                    break;
+                }
+                // fall through
+            case ST_VALUE:
+                if (is_ws(c)) {
+                    break;
+                }
+                if (c == '{') {
+                    if (push(js, false)) {
+                        js->state = ST_KEY_OR_END;
+                    }
+                } else if (c == '[') {
+                    if (push(js, true)) {
+                        path_set_index(js);
+                        js->state = ST_VALUE_OR_END;
+                    }
+                } else if (c == '"') {
+                    value_begin(js, p + 1);
+                    js->escape = false;
+                    js->state = ST_STRING_VALUE;
+                } else if (c == ',' || c == ':' || c == '}' || c == ']') {
+                    js->error = true;
+                } else {
+                    value_begin(js, p);
+                    js->state = ST_LITERAL;
+                }
+                break;
+            case ST_KEY_OR_END:
+                if (c == '}') {
+                    pop(js, c);
+                    break;
+                }
+                // fall through
+            case ST_KEY_START:
+                if (is_ws(c)) {
+                    break;
+                }
+                if (c != '"') {
+                    js->error = true;
+                    break;
+                }
+                path_truncate(js, js->stack[js->depth - 1].path_len);
+                if (js->path_len) {
+                    path_append(js, ".", 1);
+                }
+                js->escape = false;
+                js->state = ST_KEY;
+                break;
+            case ST_KEY:
+                if (c == '"' && !js->escape) {
+                    js->state = ST_COLON;
+                    break;
+                }
+                js->escape = (c == '\\' && !js->escape);
+                path_append(js, p, 1);
+                break;
+            case ST_COLON:
+                if (c == ':') {
+                    js->state = ST_VALUE;
+                } else if (!is_ws(c)) {
+                    js->error = true;
+                }
+                break;
+            case ST_STRING_VALUE:
+                if (c == '"' && !js->escape) {
+                    if (!value_end(js, data, p, true)) {
+                        return false;
+                    }
+                    break;
+                }
+                js->escape = (c == '\\' && !js->escape);
+                break;
+            case ST_LITERAL:
+                if (c == ',' || c == '}' || c == ']' || is_ws(c)) {
+                    if (!value_end(js, data, p, false)) {
+                        return false;
+                    }
+                    continue; // the delimiter belongs to the enclosing container
+                }
+                break;
+            case ST_AFTER_VALUE:
+                if (is_ws(c)) {
+                    break;
+                }
+                if (c == ',') {
+                    if (js->stack[js->depth - 1].is_array) {
+                        js->stack[js->depth - 1].index++;
+                        path_set_index(js);
+                        js->state = ST_VALUE;
+                    } else {
+                        js->state = ST_KEY_START;
+                    }
+                } else if (c == '}' || c == ']') {
+                    pop(js, c);
+                } else {
+                    js->error = true;
+                }
+                break;
+            case ST_DONE:
+            default:
+                return true; // ignore anything after the top level value
+        }
+        p++;
+    }
+
+    if (js->error) {
+        fprintf(stderr, "Error: JSON syntax error near %s\n", js->path);
+        return false;
+    }
+
+    // the value continues in the next chunk
+    if ((js->state == ST_STRING_VALUE || js->state == ST_LITERAL) && js->match >= 0) {
+        if (js->value_start) {
+            value_buffer(js, js->value_start, (size_t) (end - js->value_start));
+            js->value_start = NULL;
+        } else {
+            value_buffer(js, data, len);
+        }
+    }
+    return true;
+}
+
+bool iotc_json_stream_is_done(const IotConnectJsonStream *js) {
+    return js->done;
+}
@@ -0,0 +1,62 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "iotconnect_metrics.h"
+
+static const char *const metric_names[IOTC_METRIC_COUNT] = {
+    "discovery",
+    "sync",
+    "tls_connect",
+    "http_send",
+    "publish",
+    "c2d"
+};
+
+// Samples come from several tasks and the MQTT agent callbacks. Each one takes a critical section of a few instructions.
+static IotConnectMetricsSnapshot metrics;
+
+const char *iotc_metrics_name(IotConnectMetricId id) {
+    return id < IOTC_METRIC_COUNT ? metric_names[id] : "unknown";
+}
+
+#if IOTC_METRICS_ENABLED
+
+uint32_t iotc_metrics_start(void) {
+    return (uint32_t) xTaskGetTickCount();
+}
+
+void iotc_metrics_end(IotConnectMetricId id, uint32_t start, bool ok) {
+    iotc_metrics_record(id, (uint32_t) (((TickType_t) xTaskGetTickCount() - (TickType_t) start) * portTICK_PERIOD_MS), ok);
+}
+
+void iotc_metrics_record(IotConnectMetricId id, uint32_t duration_ms, bool ok) {
+    if (id >= IOTC_METRIC_COUNT) {
+        return;
+    }
+    taskENTER_CRITICAL();
+    iotc_histogram_add(&metrics.metrics[id].latency_ms, duration_ms);
+    if (!ok) {
+        metrics.metrics[id].failures++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+#endif
+
+void iotc_metrics_snapshot(IotConnectMetricsSnapshot *snapshot) {
+    taskENTER_CRITICAL();
+    *snapshot = metrics;
+    taskEXIT_CRITICAL();
+}
+
+void iotc_metrics_reset(void) {
+    taskENTER_CRITICAL();
+    memset(&metrics, 0, sizeof(metrics));
+    taskEXIT_CRITICAL();
+}
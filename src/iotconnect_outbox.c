@@ -0,0 +1,283 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotconnect_outbox.h"
+
+#define OUTBOX_MAGIC 0x494f5442UL // "IOTB"
+#define OUTBOX_VERSION 1
+
+// State stored at the start of the storage region, or in the header storage.
+// It is written after the record data is synced, so an interrupted append loses only the message being appended.
+// When older messages are overwritten, the advanced tail is written before the record data.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t used;
+    uint32_t count;
+    uint32_t check;
+} OutboxHeader;
+
+// Precedes every message in the data area
+typedef struct {
+    uint16_t len;
+    uint16_t len_inv;
+} RecordHeader;
+
+static uint32_t header_check(const OutboxHeader *h) {
+    return ~(h->magic ^ h->version ^ h->head ^ h->tail ^ h->used ^ h->count);
+}
+
+static size_t data_size(const IotConnectOutbox *ob) {
+    return ob->storage->size - ob->data_offset;
+}
+
+// read/write len bytes at offset in the data area, wrapping around at the end
+static int data_read(IotConnectOutbox *ob, uint32_t offset, void *buf, size_t len) {
+    size_t first = data_size(ob) - offset;
+    if (first >= len) {
+        return ob->storage->read(ob->storage->ctx, ob->data_offset + offset, buf, len);
+    }
+    if (ob->storage->read(ob->storage->ctx, ob->data_offset + offset, buf, first)) {
+        return -1;
+    }
+    return ob->storage->read(ob->storage->ctx, ob->data_offset, (uint8_t *) buf + first, len - first);
+}
+
+static int data_write(IotConnectOutbox *ob, uint32_t offset, const void *buf, size_t len) {
+    size_t first = data_size(ob) - offset;
+    if (first >= len) {
+        return ob->storage->write(ob->storage->ctx, ob->data_offset + offset, buf, len);
+    }
+    if (ob->storage->write(ob->storage->ctx, ob->data_offset + offset, buf, first)) {
+        return -1;
+    }
+    return ob->storage->write(ob->storage->ctx, ob->data_offset, (const uint8_t *) buf + first, len - first);
+}
+
+static int save_header(IotConnectOutbox *ob) {
+    OutboxHeader h;
+    h.magic = OUTBOX_MAGIC;
+    h.version = OUTBOX_VERSION;
+    h.head = ob->head;
+    h.tail = ob->tail;
+    h.used = ob->used;
+    h.count = ob->count;
+    h.check = header_check(&h);
+    if (ob->header_storage->write(ob->header_storage->ctx, 0, &h, sizeof(h))) {
+        return -1;
+    }
+    return iotc_storage_sync(ob->header_storage);
+}
+
+static int reset(IotConnectOutbox *ob) {
+    // skip the IDs of the discarded messages, so that an ack for one of them cannot match a new message
+    ob->oldest_seq += ob->count + 1;
+    ob->sent = 0;
+    ob->sent_count = 0;
+    ob->head = 0;
+    ob->tail = 0;
+    ob->used = 0;
+    ob->count = 0;
+    return save_header(ob);
+}
+
+static int read_record_header_at(IotConnectOutbox *ob, uint32_t offset, RecordHeader *rh) {
+    if (data_read(ob, offset, rh, sizeof(*rh))) {
+        return -1;
+    }
+    if ((uint16_t) ~rh->len != rh->len_inv || sizeof(*rh) + rh->len > ob->used) {
+        fprintf(stderr, "Error: Outbox record at %lu is corrupt. Discarding %lu stored messages.\n",
+                (unsigned long) offset, (unsigned long) ob->count);
+        reset(ob);
+        return -1;
+    }
+    return 0;
+}
+
+static int read_record_header(IotConnectOutbox *ob, RecordHeader *rh) {
+    return read_record_header_at(ob, ob->tail, rh);
+}
+
+static void drop_oldest(IotConnectOutbox *ob, const RecordHeader *rh) {
+    uint32_t rec_size = (uint32_t) (sizeof(*rh) + rh->len);
+    ob->tail = (uint32_t) ((ob->tail + rec_size) % data_size(ob));
+    ob->used -= rec_size;
+    ob->count--;
+    ob->oldest_seq++;
+    if (ob->sent_count) {
+        ob->sent_count--;
+    } else {
+        ob->sent = ob->tail; // an unsent message was dropped
+    }
+    if (0 == ob->count) {
+        ob->head = ob->tail = ob->used = ob->sent = 0;
+    }
+}
+
+int iotc_outbox_init(IotConnectOutbox *ob, IotConnectStorage *storage, IotConnectStorage *header_storage, bool overwrite_oldest) {
+    OutboxHeader h;
+    size_t data_offset = header_storage ? 0 : sizeof(OutboxHeader);
+
+    if (!ob || !storage || !storage->read || !storage->write || storage->size <= data_offset + sizeof(RecordHeader)) {
+        return EXIT_FAILURE;
+    }
+    if (header_storage && (!header_storage->read || !header_storage->write || header_storage->size < sizeof(OutboxHeader))) {
+        return EXIT_FAILURE;
+    }
+    memset(ob, 0, sizeof(*ob));
+    ob->storage = storage;
+    ob->header_storage = header_storage ? header_storage : storage;
+    ob->data_offset = data_offset;
+    ob->overwrite_oldest = overwrite_oldest;
+
+    if (ob->header_storage->read(ob->header_storage->ctx, 0, &h, sizeof(h))) {
+        fprintf(stderr, "Error: Unable to read the outbox header\n");
+        return EXIT_FAILURE;
+    }
+    if (h.magic != OUTBOX_MAGIC || h.version != OUTBOX_VERSION || h.check != header_check(&h)
+        || h.head >= data_size(ob) || h.tail >= data_size(ob) || h.used > data_size(ob)) {
+        // blank, foreign or resized storage
+        return reset(ob) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    ob->head = h.head;
+    ob->tail = h.tail;
+    ob->sent = h.tail;
+    ob->used = h.used;
+    ob->count = h.count;
+    if (ob->count) {
+        printf("Outbox has %lu stored messages.\n", (unsigned long) ob->count);
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotc_outbox_append(IotConnectOutbox *ob, const void *data, size_t len) {
+    RecordHeader rh;
+    size_t rec_size = sizeof(rh) + len;
+
+    if (len > UINT16_MAX || rec_size > data_size(ob)) {
+        ob->stats.rejected++;
+        return EXIT_FAILURE;
+    }
+
+    bool dropped = false;
+    while (data_size(ob) - ob->used < rec_size) {
+        RecordHeader oldest;
+        if (!ob->overwrite_oldest) {
+            ob->stats.rejected++;
+            return EXIT_FAILURE;
+        }
+        if (read_record_header(ob, &oldest)) {
+            if (data_size(ob) - ob->used < rec_size) {
+                ob->stats.rejected++; // the storage could not be read
+                return EXIT_FAILURE;
+            }
+            dropped = false; // the outbox was reset and the header saved, so there is room now
+            break;
+        }
+        drop_oldest(ob, &oldest);
+        ob->stats.overwritten++;
+        dropped = true;
+    }
+
+    // Move the tail past the dropped messages before their space is overwritten,
+    // so that a reset during the write does not leave the tail on a torn record.
+    if (dropped && save_header(ob)) {
+        fprintf(stderr, "Error: Unable to write to the outbox storage\n");
+        ob->stats.rejected++;
+        return EXIT_FAILURE;
+    }
+
+    rh.len = (uint16_t) len;
+    rh.len_inv = (uint16_t) ~rh.len;
+    // one sync for the record, so that it is durable before the header points past it
+    if (data_write(ob, ob->head, &rh, sizeof(rh))
+        || data_write(ob, (uint32_t) ((ob->head + sizeof(rh)) % data_size(ob)), data, len)
+        || iotc_storage_sync(ob->storage)) {
+        fprintf(stderr, "Error: Unable to write to the outbox storage\n");
+        ob->stats.rejected++;
+        return EXIT_FAILURE;
+    }
+    ob->head = (uint32_t) ((ob->head + rec_size) % data_size(ob));
+    ob->used += (uint32_t) rec_size;
+    ob->count++;
+    ob->stats.appended++;
+    return save_header(ob) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int iotc_outbox_peek(IotConnectOutbox *ob, void *buf, size_t buf_size, size_t *len) {
+    RecordHeader rh;
+
+    if (0 == ob->count || read_record_header(ob, &rh)) {
+        return EXIT_FAILURE;
+    }
+    if (rh.len > buf_size) {
+        fprintf(stderr, "Error: Outbox message of %u bytes does not fit into %lu bytes. Discarding.\n",
+                rh.len, (unsigned long) buf_size);
+        iotc_outbox_pop(ob);
+        return EXIT_FAILURE;
+    }
+    if (data_read(ob, (uint32_t) ((ob->tail + sizeof(rh)) % data_size(ob)), buf, rh.len)) {
+        return EXIT_FAILURE;
+    }
+    *len = rh.len;
+    return EXIT_SUCCESS;
+}
+
+int iotc_outbox_pop(IotConnectOutbox *ob) {
+    RecordHeader rh;
+
+    if (0 == ob->count || read_record_header(ob, &rh)) {
+        return EXIT_FAILURE;
+    }
+    drop_oldest(ob, &rh);
+    ob->stats.drained++;
+    return save_header(ob) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int iotc_outbox_peek_unsent(IotConnectOutbox *ob, void *buf, size_t buf_size, size_t *len, uint32_t *id) {
+    RecordHeader rh;
+
+    if (0 == iotc_outbox_unsent_count(ob) || read_record_header_at(ob, ob->sent, &rh)) {
+        return EXIT_FAILURE;
+    }
+    if (rh.len > buf_size) {
+        fprintf(stderr, "Error: Outbox message of %u bytes does not fit into %lu bytes.\n", rh.len, (unsigned long) buf_size);
+        if (0 == ob->sent_count) {
+            iotc_outbox_pop(ob); // it is the oldest one, so it can be discarded
+        }
+        return EXIT_FAILURE;
+    }
+    if (data_read(ob, (uint32_t) ((ob->sent + sizeof(rh)) % data_size(ob)), buf, rh.len)) {
+        return EXIT_FAILURE;
+    }
+    *len = rh.len;
+    *id = ob->oldest_seq + ob->sent_count;
+    return EXIT_SUCCESS;
+}
+
+void iotc_outbox_mark_sent(IotConnectOutbox *ob, uint32_t id, size_t len) {
+    if (0 == iotc_outbox_unsent_count(ob) || id != ob->oldest_seq + ob->sent_count) {
+        return;
+    }
+    ob->sent = (uint32_t) ((ob->sent + sizeof(RecordHeader) + len) % data_size(ob));
+    ob->sent_count++;
+}
+
+int iotc_outbox_ack(IotConnectOutbox *ob, uint32_t id) {
+    if (0 == ob->sent_count || id != ob->oldest_seq) {
+        return EXIT_FAILURE;
+    }
+    return iotc_outbox_pop(ob);
+}
+
+void iotc_outbox_rewind(IotConnectOutbox *ob) {
+    ob->sent = ob->tail;
+    ob->sent_count = 0;
+}
@@ -0,0 +1,194 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "message_buffer.h"
+
+#include "iotconnect_sampler.h"
+
+#ifndef IOTC_SAMPLER_TASK_STACK_SIZE
+#define IOTC_SAMPLER_TASK_STACK_SIZE 2048
+#endif
+
+// Above the application and the SDK tasks, so that slow sends do not delay the sampling
+#ifndef IOTC_SAMPLER_TASK_PRIORITY
+#define IOTC_SAMPLER_TASK_PRIORITY (tskIDLE_PRIORITY + 4)
+#endif
+
+// Each message in the buffer is preceded by its length
+#define SAMPLE_RECORD_SIZE (sizeof(IotConnectSample) + sizeof(size_t))
+#define SAMPLE_RING_SIZE (IOTC_SAMPLER_RING_SAMPLES * SAMPLE_RECORD_SIZE)
+
+typedef struct {
+    IotConnectSamplerConfig config;
+    TickType_t period;
+    TickType_t deadline;
+} Sampler;
+
+// Registration is closed once the task starts, so the task reads the samplers without locking.
+static Sampler samplers[IOTC_SAMPLER_MAX_SAMPLERS];
+static int num_samplers = 0;
+static bool is_started = false;
+
+// The sampler task is the only writer and the publishing task the only reader, so the ring needs no locking.
+static uint8_t ring_storage[SAMPLE_RING_SIZE + 1]; // message buffers need one extra byte
+static StaticMessageBuffer_t ring_struct;
+static MessageBufferHandle_t ring = NULL;
+
+// Written by the sampler task, and copied in a critical section by the readers
+static IotConnectSamplerStats sampler_stats[IOTC_SAMPLER_MAX_SAMPLERS];
+static IotConnectSampleRingStats ring_stats;
+
+static uint32_t ring_used(void) {
+    return (uint32_t) ((SAMPLE_RING_SIZE - xMessageBufferSpacesAvailable(ring)) / SAMPLE_RECORD_SIZE);
+}
+
+static void run_sampler(int id, Sampler *s) {
+    IotConnectSamplerStats *stats = &sampler_stats[id];
+    TickType_t now = xTaskGetTickCount();
+    IotConnectSample sample = {0};
+    bool ok = s->config.cb(s->config.user_data, &sample.value);
+
+    taskENTER_CRITICAL();
+    stats->runs++;
+    iotc_histogram_add(&stats->jitter_ms, (uint32_t) ((now - s->deadline) * portTICK_PERIOD_MS));
+    taskEXIT_CRITICAL();
+
+    if (ok) {
+        sample.time_ms = (uint32_t) (now * portTICK_PERIOD_MS);
+        sample.sampler = (uint16_t) id;
+        if (xMessageBufferSend(ring, &sample, sizeof(sample), 0) == 0) {
+            taskENTER_CRITICAL();
+            stats->dropped++;
+            taskEXIT_CRITICAL();
+        } else {
+            uint32_t used = ring_used();
+            taskENTER_CRITICAL();
+            if (used > ring_stats.high_water) {
+                ring_stats.high_water = used;
+            }
+            taskEXIT_CRITICAL();
+        }
+    } else {
+        taskENTER_CRITICAL();
+        stats->failures++;
+        taskEXIT_CRITICAL();
+    }
+
+    s->deadline += s->period;
+    now = xTaskGetTickCount();
+    if ((int32_t) (now - s->deadline) >= 0) {
+        // Skip the deadlines that have already passed, instead of calling the sampler back to back
+        uint32_t missed = (uint32_t) ((now - s->deadline) / s->period) + 1;
+        s->deadline += (TickType_t) (missed * s->period);
+        taskENTER_CRITICAL();
+        stats->missed += missed;
+        taskEXIT_CRITICAL();
+    }
+}
+
+static void sampler_task(void *pvParameters) {
+    (void) pvParameters;
+    TickType_t wake = xTaskGetTickCount();
+
+    for (int i = 0; i < num_samplers; i++) {
+        samplers[i].deadline = wake;
+    }
+    for (;;) {
+        TickType_t next = samplers[0].deadline;
+        for (int i = 1; i < num_samplers; i++) {
+            if ((int32_t) (samplers[i].deadline - next) < 0) {
+                next = samplers[i].deadline;
+            }
+        }
+        // Sleeps until an absolute time, so the time spent in the callbacks does not add up
+        if ((int32_t) (next - wake) > 0) {
+            xTaskDelayUntil(&wake, next - wake);
+        }
+        for (int i = 0; i < num_samplers; i++) {
+            if ((int32_t) (samplers[i].deadline - wake) <= 0) {
+                run_sampler(i, &samplers[i]);
+            }
+        }
+    }
+}
+
+int iotc_sampler_register(const IotConnectSamplerConfig *config) {
+    if (is_started || num_samplers >= IOTC_SAMPLER_MAX_SAMPLERS || !config->name || !config->cb) {
+        fprintf(stderr, "Error: Cannot register sampler %s\n", config->name ? config->name : "(no name)");
+        return -1;
+    }
+    Sampler *s = &samplers[num_samplers];
+    s->config = *config;
+    s->period = pdMS_TO_TICKS(config->period_ms);
+    if (0 == s->period) {
+        s->period = 1;
+    }
+    return num_samplers++;
+}
+
+int iotc_sampler_start(void) {
+    if (is_started) {
+        return EXIT_SUCCESS;
+    }
+    if (0 == num_samplers) {
+        fprintf(stderr, "Error: No samplers are registered\n");
+        return EXIT_FAILURE;
+    }
+    ring = xMessageBufferCreateStatic(sizeof(ring_storage), ring_storage, &ring_struct);
+    is_started = true;
+    if (pdPASS != xTaskCreate(sampler_task, "IoTC-Sample", IOTC_SAMPLER_TASK_STACK_SIZE, NULL, IOTC_SAMPLER_TASK_PRIORITY, NULL)) {
+        fprintf(stderr, "Error: Failed to create the sampler task\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+size_t iotc_sampler_receive(IotConnectSample *samples, size_t max_samples, uint32_t wait_ms) {
+    size_t count = 0;
+    TickType_t wait = pdMS_TO_TICKS(wait_ms);
+
+    if (!ring) {
+        vTaskDelay(wait);
+        return 0;
+    }
+    while (count < max_samples) {
+        if (xMessageBufferReceive(ring, &samples[count], sizeof(samples[count]), count ? 0 : wait) != sizeof(samples[count])) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+int iotc_sampler_count(void) {
+    return num_samplers;
+}
+
+const char *iotc_sampler_name(int id) {
+    return (id >= 0 && id < num_samplers) ? samplers[id].config.name : NULL;
+}
+
+void iotc_sampler_get_stats(int id, IotConnectSamplerStats *stats) {
+    if (id < 0 || id >= num_samplers) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    taskENTER_CRITICAL();
+    *stats = sampler_stats[id];
+    taskEXIT_CRITICAL();
+}
+
+void iotc_sampler_get_ring_stats(IotConnectSampleRingStats *stats) {
+    taskENTER_CRITICAL();
+    *stats = ring_stats;
+    taskEXIT_CRITICAL();
+    stats->used = ring ? ring_used() : 0;
+    stats->capacity = IOTC_SAMPLER_RING_SAMPLES;
+}
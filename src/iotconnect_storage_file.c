@@ -0,0 +1,64 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotconnect_storage.h"
+
+static int file_read(void *ctx, size_t offset, void *buf, size_t len) {
+    FILE *f = (FILE *) ctx;
+    if (fseek(f, (long) offset, SEEK_SET)) {
+        return -1;
+    }
+    // reading past the end of a new file returns zeros, like erased storage that was never written
+    size_t got = fread(buf, 1, len, f);
+    if (got < len) {
+        memset((char *) buf + got, 0, len - got);
+        clearerr(f);
+    }
+    return 0;
+}
+
+static int file_write(void *ctx, size_t offset, const void *buf, size_t len) {
+    FILE *f = (FILE *) ctx;
+    if (fseek(f, (long) offset, SEEK_SET)) {
+        return -1;
+    }
+    return (fwrite(buf, 1, len, f) != len) ? -1 : 0;
+}
+
+static int file_sync(void *ctx) {
+    return fflush((FILE *) ctx) ? -1 : 0;
+}
+
+int iotc_storage_file_open(IotConnectStorage *storage, const char *path, size_t size) {
+    FILE *f;
+
+    if (!storage || !path || !size) {
+        return EXIT_FAILURE;
+    }
+    f = fopen(path, "r+b");
+    if (!f) {
+        f = fopen(path, "w+b");
+    }
+    if (!f) {
+        fprintf(stderr, "Error: Unable to open storage file %s\n", path);
+        return EXIT_FAILURE;
+    }
+    storage->ctx = f;
+    storage->size = size;
+    storage->read = file_read;
+    storage->write = file_write;
+    storage->sync = file_sync;
+    return EXIT_SUCCESS;
+}
+
+void iotc_storage_file_close(IotConnectStorage *storage) {
+    if (storage && storage->ctx) {
+        fclose((FILE *) storage->ctx);
+        storage->ctx = NULL;
+    }
+}
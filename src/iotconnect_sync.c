@@ -5,28 +5,120 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* Include config as the first non-system header. */
 #include "app_config.h"
 
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
 #include "iotconnect_discovery.h"
-#include "iotconnect_certs.h"
+#include "iotconnect_certs_der.h"
 #include "iotc_http_request.h"
+#include "iotconnect_json_stream.h"
+#include "iotconnect_metrics.h"
+#include "iotconnect_storage.h"
 #include "iotconnect_sync.h"
+#include "iotconnect_timestamp.h"
 
 #define RESOURCE_PATH_DSICOVERY "/api/sdk/cpid/%s/lang/M_C/ver/2.0/env/%s"
 #define RESOURCE_PATH_SYNC "%ssync"
 
+// Same as IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_TEMPLATE, but also asks for the SDK config, which has the data frequency
+#define SYNC_POST_DATA_TEMPLATE "{\"cpId\":\"%s\",\"uniqueId\":\"%s\",\"option\":{\"attribute\":false,\"setting\":false,\"protocol\":true,\"device\":false,\"sdkConfig\":true,\"rule\":false}}"
+
+// How long a cached sync response can be used before running a full sync.
+// The age can only be checked if the device has the wall clock time when the record is loaded.
+#ifndef IOTC_SYNC_CACHE_TTL_S
+#define IOTC_SYNC_CACHE_TTL_S (7 * 24 * 60 * 60)
+#endif
+
+// Space for the values of the discovery and sync response fields that are used by the SDK.
+// The responses are streamed, so the rest of the response does not need to fit anywhere.
+#ifndef IOTC_SYNC_RESPONSE_MAX_FIELDS_LEN
+#define IOTC_SYNC_RESPONSE_MAX_FIELDS_LEN 1024
+#endif
+
+// The background sync runs the HTTPS requests, so it needs about as much stack as the MQTT agent task
+#ifndef IOTC_SYNC_TASK_STACK_SIZE
+#define IOTC_SYNC_TASK_STACK_SIZE 6144
+#endif
+
+#ifndef IOTC_SYNC_TASK_PRIORITY
+#define IOTC_SYNC_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
+#define SYNC_CACHE_MAGIC 0x49534331UL // "ISC1"
+#define SYNC_CACHE_VERSION 2
+
+// Cached sync record header. It is followed by the cached strings,
+// each prefixed by a single length byte and not null terminated.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t data_len;
+    uint32_t saved_time; // seconds since epoch, or 0 if unknown
+    uint32_t data_frequency; // seconds
+    uint32_t check;
+} SyncCacheHeader;
+
+// Fields read by iotcl_discovery_parse_discovery_response() and iotcl_discovery_parse_sync_response()
+static const char* const discovery_paths[] = { "baseUrl" };
+static const char* const sync_paths[] = {
+    "d.ds", "d.cpId", "d.dtg", "d.ee", "d.rc", "d.at",
+    "d.p.n", "d.p.h", "d.p.id", "d.p.un", "d.p.pwd", "d.p.pub", "d.p.sub",
+    "d.sc.df" // read by parse_data_frequency(), as the lib ignores it
+};
+#define MAX_CAPTURED_FIELDS (sizeof(sync_paths) / sizeof(sync_paths[0]))
+
+typedef struct {
+    uint16_t offset; // in the arena
+    uint16_t len;
+    bool is_string;
+    bool present;
+} CapturedField;
+
+// Values of the response fields that we need, collected as the response body streams in
+typedef struct {
+    IotConnectJsonStream js;
+    const char* const* paths;
+    size_t num_paths;
+    CapturedField fields[MAX_CAPTURED_FIELDS];
+    char* arena;
+    size_t arena_size;
+    size_t arena_used;
+} ResponseCapture;
+
+// A profile and its reference count. The strings follow the block in the same allocation.
+typedef struct {
+    IotConnectSyncProfile profile; // must be first
+    uint32_t refs;
+    bool pinned; // a legacy getter returned a pointer into the profile, so it holds a reference that is never released
+} SyncProfileBlock;
+
+// The sync state is guarded by sync_lock. The current profile is swapped in a critical section.
 static IotclDiscoveryResponse* discovery_response = NULL;
-static IotclSyncResponse* sync_response = NULL;
 static IotclSyncResult last_sync_result = IOTCL_SR_UNKNOWN_DEVICE_STATUS;
+static uint32_t data_frequency = 0; // of the last response, in seconds between telemetry messages, or 0 if not limited
+static SyncProfileBlock* current_profile = NULL;
+static uint32_t profile_version = 0;
+static StaticSemaphore_t sync_lock_storage;
+static SemaphoreHandle_t sync_lock = NULL;
+static TaskHandle_t resync_task_handle = NULL;
+static IotConnectStorage *cache_storage = NULL;
+static bool cache_invalidated = false;
 
 
-static void dump_response(const char* message, IotConnectHttpRequest* response) {
+static void dump_response(const char* message, const char* json) {
     printf("%s", message);
-    if (response->response) {
-        printf(" Response was:\r\n----\r\n%s\r\n----\r\n", response->response);
+    if (json) {
+        printf(" Extracted response was:\r\n----\r\n%s\r\n----\r\n", json);
     }
     else {
         printf(" Response was empty\r\n");
@@ -70,44 +162,194 @@ static void report_sync_error(IotclSyncResponse* response, const char* sync_resp
         printf("WARN: report_sync_error called, but no error returned?\r\n");
         break;
     }
-    printf("Raw server response was:\r\n--------------\r\n%s\r\n--------------\r\n", sync_response_str);
+    printf("Extracted server response was:\r\n--------------\r\n%s\r\n--------------\r\n", sync_response_str);
 }
 
-static IotclDiscoveryResponse* run_http_discovery(const char* cpid, const char* env) {
-    IotConnectHttpRequest req = { 0 };
+static bool on_captured_value(void* user_data, size_t path_index, const char* value, size_t value_len, bool is_string) {
+    ResponseCapture* c = (ResponseCapture*) user_data;
+    CapturedField* f = &c->fields[path_index];
 
-    char resource_str_buff[sizeof(RESOURCE_PATH_DSICOVERY) + CONFIG_IOTCONNECT_CPID_MAX_LEN + CONFIG_IOTCONNECT_ENV_MAX_LEN + 10 /* slack */];
-    sprintf(resource_str_buff, RESOURCE_PATH_DSICOVERY, cpid, env);
+    if (value_len > c->arena_size - c->arena_used) {
+        printf("WARN: Response field %s does not fit into %u bytes\r\n", c->paths[path_index], IOTC_SYNC_RESPONSE_MAX_FIELDS_LEN);
+        return false;
+    }
+    memcpy(&c->arena[c->arena_used], value, value_len);
+    f->offset = (uint16_t) c->arena_used;
+    f->len = (uint16_t) value_len;
+    f->is_string = is_string;
+    f->present = true;
+    c->arena_used += value_len;
+    return true;
+}
 
-    req.host_name = IOTCONNECT_DISCOVERY_HOSTNAME;
-    req.resource = resource_str_buff;
-    req.tls_cert = CERT_GODADDY_INT_SECURE_G2;
+static int on_response_body(void* user_data, const char* data, size_t len) {
+    ResponseCapture* c = (ResponseCapture*) user_data;
+    return iotc_json_stream_feed(&c->js, data, len) ? 0 : -1;
+}
 
-    int status = iotconnect_https_request(&req);
+static ResponseCapture* capture_create(const char* const* paths, size_t num_paths) {
+    ResponseCapture* c = calloc(1, sizeof(ResponseCapture) + IOTC_SYNC_RESPONSE_MAX_FIELDS_LEN);
+    if (!c) {
+        printf("Failed to allocate the response capture\r\n");
+        return NULL;
+    }
+    c->paths = paths;
+    c->num_paths = num_paths;
+    c->arena = (char*) &c[1];
+    c->arena_size = IOTC_SYNC_RESPONSE_MAX_FIELDS_LEN;
+    iotc_json_stream_init(&c->js, paths, num_paths, on_captured_value, c);
+    return c;
+}
 
-    if (status != EXIT_SUCCESS) {
-        printf("Discovery: iotconnect_https_request() error code: %x data: %s\r\n", status, req.response);
+static bool json_append(char* buf, size_t size, size_t* len, const char* str, size_t str_len) {
+    if (*len + str_len >= size) {
+        return false;
+    }
+    memcpy(&buf[*len], str, str_len);
+    *len += str_len;
+    buf[*len] = 0;
+    return true;
+}
+
+// Length of the parent path of the first len characters of a dot separated path. 0 for a top level key.
+static size_t path_parent_len(const char* path, size_t len) {
+    while (len > 0 && path[--len] != '.') {
+    }
+    return len;
+}
+
+// Rebuilds a JSON document that contains only the captured fields, in the same structure as the original,
+// so that it can be handed to the iotc-c-lib parsers. Paths that share a parent object must be listed together.
+static char* capture_to_json(const ResponseCapture* c) {
+    size_t size = 2 + c->arena_used + 1;
+    for (size_t i = 0; i < c->num_paths; i++) {
+        size += strlen(c->paths[i]) * 2 + 10; // quotes, colons, braces and commas around each key
+    }
+    char* buf = malloc(size);
+    if (!buf) {
+        printf("Failed to allocate the extracted response\r\n");
         return NULL;
     }
-    if (NULL == req.response || 0 == strlen(req.response)) {
-        dump_response("Discovery: Unable to obtain HTTP response,", &req);
+
+    size_t len = 0;
+    const char* open = ""; // path of the innermost open object, not counting the root object
+    size_t open_len = 0;
+    bool ok = json_append(buf, size, &len, "{", 1);
+    bool first = true;
+    for (size_t i = 0; ok && i < c->num_paths; i++) {
+        const CapturedField* f = &c->fields[i];
+        const char* path = c->paths[i];
+        size_t parent_len = path_parent_len(path, strlen(path));
+        const char* leaf = parent_len ? &path[parent_len + 1] : path;
+        if (!f->present) {
+            continue;
+        }
+
+        // close objects until the open path is a parent of this one
+        while (open_len > 0 && !(open_len <= parent_len && 0 == strncmp(open, path, open_len)
+                                 && (open_len == parent_len || path[open_len] == '.'))) {
+            ok = ok && json_append(buf, size, &len, "}", 1);
+            open_len = path_parent_len(open, open_len);
+        }
+        // open the missing parent objects
+        while (ok && open_len < parent_len) {
+            size_t start = open_len ? open_len + 1 : 0;
+            const char* end = memchr(&path[start], '.', parent_len - start);
+            size_t seg_end = end ? (size_t) (end - path) : parent_len;
+            ok = (first || json_append(buf, size, &len, ",", 1))
+                 && json_append(buf, size, &len, "\"", 1)
+                 && json_append(buf, size, &len, &path[start], seg_end - start)
+                 && json_append(buf, size, &len, "\":{", 3);
+            first = true;
+            open = path;
+            open_len = seg_end;
+        }
+        ok = ok && (first || json_append(buf, size, &len, ",", 1))
+             && json_append(buf, size, &len, "\"", 1)
+             && json_append(buf, size, &len, leaf, strlen(leaf))
+             && json_append(buf, size, &len, f->is_string ? "\":\"" : "\":", f->is_string ? 3 : 2)
+             && json_append(buf, size, &len, &c->arena[f->offset], f->len)
+             && (!f->is_string || json_append(buf, size, &len, "\"", 1));
+        first = false;
+    }
+    while (ok && open_len > 0) {
+        ok = json_append(buf, size, &len, "}", 1);
+        open_len = path_parent_len(open, open_len);
+    }
+    ok = ok && json_append(buf, size, &len, "}", 1);
+    if (!ok) {
+        printf("Failed to rebuild the extracted response\r\n");
+        free(buf);
         return NULL;
     }
+    return buf;
+}
 
-    char* json_start = strstr(req.response, "{");
-    if (NULL == json_start) {
-        dump_response("Discovery: No json response from server.", &req);
+// Runs the request, streaming the response body through the field extractor.
+// Returns the extracted fields as a JSON string that must be freed by the caller, or NULL on failure.
+static char* run_http_capture(const char* label, IotConnectHttpRequest* req, const char* const* paths, size_t num_paths) {
+    char* json = NULL;
+    ResponseCapture* c = capture_create(paths, num_paths);
+    if (!c) {
         return NULL;
     }
-    if (json_start != req.response) {
-        dump_response("WARN: Expected JSON to start immediately in the returned data.", &req);
+
+    req->body_cb = on_response_body;
+    req->user_data = c;
+    int status = iotconnect_https_request(req);
+
+    if (status != EXIT_SUCCESS) {
+        printf("%s: iotconnect_https_request() error code: %x\r\n", label, status);
+    } else if (!iotc_json_stream_is_done(&c->js)) {
+        printf("%s: No complete json response from server.\r\n", label);
+    } else {
+        json = capture_to_json(c);
     }
+    free(c);
+    return json;
+}
 
-    IotclDiscoveryResponse* ret = iotcl_discovery_parse_discovery_response(json_start);
-    if (!ret) {
-        dump_response("Discovery: Unable to parse HTTP response,", &req);
+static bool on_data_frequency(void* user_data, size_t path_index, const char* value, size_t value_len, bool is_string) {
+    uint32_t df = 0;
+    (void) path_index;
+    for (size_t i = 0; !is_string && i < value_len && value[i] >= '0' && value[i] <= '9'; i++) {
+        df = df * 10 + (uint32_t) (value[i] - '0');
     }
+    *(uint32_t*) user_data = df;
+    return true;
+}
+
+// Returns d.sc.df from the extracted sync response, or 0 if it is not there
+static uint32_t parse_data_frequency(const char* json) {
+    static const char* const df_path[] = { "d.sc.df" };
+    IotConnectJsonStream js;
+    uint32_t df = 0;
+
+    iotc_json_stream_init(&js, df_path, 1, on_data_frequency, &df);
+    (void) iotc_json_stream_feed(&js, json, strlen(json));
+    return df;
+}
+
+static IotclDiscoveryResponse* run_http_discovery(const char* cpid, const char* env) {
+    IotConnectHttpRequest req = { 0 };
+
+    char resource_str_buff[sizeof(RESOURCE_PATH_DSICOVERY) + CONFIG_IOTCONNECT_CPID_MAX_LEN + CONFIG_IOTCONNECT_ENV_MAX_LEN + 10 /* slack */];
+    sprintf(resource_str_buff, RESOURCE_PATH_DSICOVERY, cpid, env);
 
+    req.host_name = IOTCONNECT_DISCOVERY_HOSTNAME;
+    req.resource = resource_str_buff;
+    req.tls_cert = IOTC_CERT_GODADDY_SECURE_G2;
+
+    char* json = run_http_capture("Discovery", &req, discovery_paths, sizeof(discovery_paths) / sizeof(discovery_paths[0]));
+    if (!json) {
+        return NULL;
+    }
+
+    IotclDiscoveryResponse* ret = iotcl_discovery_parse_discovery_response(json);
+    if (!ret) {
+        dump_response("Discovery: Unable to parse HTTP response,", json);
+    }
+    free(json);
     return ret;
 }
 
@@ -124,7 +366,7 @@ static IotclSyncResponse* run_http_sync(const char* cpid, const char* uniqueid)
     sprintf(sync_path, RESOURCE_PATH_SYNC, discovery_response->path);
     snprintf(post_data,
         IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_MAX_LEN, /*total length should not exceed MTU size*/
-        IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_TEMPLATE,
+        SYNC_POST_DATA_TEMPLATE,
         cpid,
         uniqueid
     );
@@ -132,114 +374,452 @@ static IotclSyncResponse* run_http_sync(const char* cpid, const char* uniqueid)
     req.host_name = discovery_response->host;
     req.resource = sync_path;
     req.payload = post_data;
-    req.tls_cert = CERT_GODADDY_INT_SECURE_G2;
+    req.tls_cert = IOTC_CERT_GODADDY_SECURE_G2;
 
-    int status = iotconnect_https_request(&req);
+    char* json = run_http_capture("Sync", &req, sync_paths, sizeof(sync_paths) / sizeof(sync_paths[0]));
     free(sync_path);
+    if (!json) {
+        return NULL;
+    }
 
-    if (status != EXIT_SUCCESS) {
-        printf("Sync: iotconnect_https_request() error code: %x data: %s\r\n", status, req.response);
+    IotclSyncResponse* ret = iotcl_discovery_parse_sync_response(json);
+    if (!ret) {
+        dump_response("Sync: Unable to parse HTTP response,", json);
+    } else {
+        last_sync_result = ret->ds;
+        data_frequency = parse_data_frequency(json);
+    }
+    if (!ret || ret->ds != IOTCL_SR_OK) {
+        report_sync_error(ret, json);
+        iotcl_discovery_free_sync_response(ret);
+        ret = NULL;
+    }
+    free(json);
+
+    return ret;
+
+}
+
+// Cached fields, in the order they are stored
+static char** cache_fields(IotclSyncResponse* r, size_t index) {
+    switch (index) {
+    case 0: return &r->dtg;
+    case 1: return &r->broker.host;
+    case 2: return &r->broker.client_id;
+    case 3: return &r->broker.user_name;
+    case 4: return &r->broker.pub_topic;
+    case 5: return &r->broker.sub_topic;
+    default: return NULL;
+    }
+}
+
+static uint32_t cache_check(const SyncCacheHeader* h, const uint8_t* data) {
+    // FNV-1a over the header fields and the data
+    uint32_t hash = 2166136261UL;
+    const uint32_t fields[] = { h->magic, h->version, h->data_len, h->saved_time, h->data_frequency };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        hash = (hash ^ fields[i]) * 16777619UL;
+    }
+    for (size_t i = 0; i < h->data_len; i++) {
+        hash = (hash ^ data[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+static void cache_save(IotclSyncResponse* r) {
+    SyncCacheHeader h = { 0 };
+    uint8_t* record;
+    size_t data_len = 0;
+    char** field;
+
+    if (!cache_storage) {
+        return;
+    }
+
+    for (size_t i = 0; (field = cache_fields(r, i)); i++) {
+        size_t len = *field ? strlen(*field) : 0;
+        if (len > UINT8_MAX) {
+            printf("WARN: Sync response field %u is too long to be cached\r\n", (unsigned int) i);
+            return;
+        }
+        data_len += 1 + len;
+    }
+    if (sizeof(h) + data_len > cache_storage->size) {
+        printf("WARN: Sync response does not fit into the cache storage\r\n");
+        return;
+    }
+
+    record = malloc(sizeof(h) + data_len);
+    if (!record) {
+        printf("Failed to allocate the sync cache record\r\n");
+        return;
+    }
+    uint8_t* p = record + sizeof(h);
+    for (size_t i = 0; (field = cache_fields(r, i)); i++) {
+        size_t len = *field ? strlen(*field) : 0;
+        *p++ = (uint8_t) len;
+        memcpy(p, *field, len);
+        p += len;
+    }
+
+    time_t now = time(NULL);
+    h.magic = SYNC_CACHE_MAGIC;
+    h.version = SYNC_CACHE_VERSION;
+    h.data_len = (uint16_t) data_len;
+    h.saved_time = (now >= IOTC_TIMESTAMP_MIN_VALID_TIME) ? (uint32_t) now : 0;
+    h.data_frequency = data_frequency;
+    h.check = cache_check(&h, record + sizeof(h));
+    memcpy(record, &h, sizeof(h));
+
+    if (cache_storage->write(cache_storage->ctx, 0, record, sizeof(h) + data_len) || iotc_storage_sync(cache_storage)) {
+        printf("WARN: Failed to save the sync cache record\r\n");
+    }
+    free(record);
+}
+
+static IotclSyncResponse* cache_load(void) {
+    SyncCacheHeader h;
+    IotclSyncResponse* ret = NULL;
+    uint8_t* data = NULL;
+    char** field;
+
+    if (!cache_storage || cache_invalidated) {
+        return NULL;
+    }
+    if (cache_storage->read(cache_storage->ctx, 0, &h, sizeof(h))) {
+        return NULL;
+    }
+    if (h.magic != SYNC_CACHE_MAGIC || h.version != SYNC_CACHE_VERSION || sizeof(h) + h.data_len > cache_storage->size) {
         return NULL;
     }
 
-    if (NULL == req.response || 0 == strlen(req.response)) {
-        dump_response("Sync: Unable to obtain HTTP response,", &req);
+    time_t now = time(NULL);
+    if (h.saved_time && now >= IOTC_TIMESTAMP_MIN_VALID_TIME && (uint32_t) now - h.saved_time > IOTC_SYNC_CACHE_TTL_S) {
+        printf("Cached sync response has expired.\r\n");
         return NULL;
     }
 
-    char* json_start = strstr(req.response, "{");
-    if (NULL == json_start) {
-        dump_response("Sync: No json response from server.", &req);
+    data = malloc(h.data_len);
+    if (!data) {
         return NULL;
     }
-    if (json_start != req.response) {
-        dump_response("WARN: Expected JSON to start immediately in the returned data.", &req);
+    if (cache_storage->read(cache_storage->ctx, sizeof(h), data, h.data_len) || cache_check(&h, data) != h.check) {
+        printf("WARN: Cached sync response is corrupt\r\n");
+        goto cleanup;
     }
 
-    IotclSyncResponse* ret = iotcl_discovery_parse_sync_response(json_start);
+    ret = calloc(1, sizeof(IotclSyncResponse));
     if (!ret) {
-        dump_response("Sync: Unable to parse HTTP response,", &req);
+        goto cleanup;
     }
-    last_sync_result = ret->ds;
-    if (!ret || ret->ds != IOTCL_SR_OK) {
-        report_sync_error(ret, req.response);
-        iotcl_discovery_free_sync_response(ret);
-        ret = NULL;
+    ret->ds = IOTCL_SR_OK;
+    data_frequency = h.data_frequency;
+    const uint8_t* p = data;
+    const uint8_t* end = data + h.data_len;
+    for (size_t i = 0; (field = cache_fields(ret, i)); i++) {
+        if (p >= end || p + 1 + *p > end) {
+            printf("WARN: Cached sync response is truncated\r\n");
+            iotcl_discovery_free_sync_response(ret);
+            ret = NULL;
+            goto cleanup;
+        }
+        size_t len = *p++;
+        *field = malloc(len + 1);
+        if (!*field) {
+            iotcl_discovery_free_sync_response(ret);
+            ret = NULL;
+            goto cleanup;
+        }
+        memcpy(*field, p, len);
+        (*field)[len] = 0;
+        p += len;
     }
 
+cleanup:
+    free(data);
     return ret;
+}
+
+void iotc_sync_set_cache_storage(IotConnectStorage* storage) {
+    cache_storage = storage;
+}
+
+void iotc_sync_invalidate_cache(void) {
+    SyncCacheHeader h = { 0 };
+    cache_invalidated = true;
+    if (cache_storage) {
+        if (0 == cache_storage->write(cache_storage->ctx, 0, &h, sizeof(h))) {
+            (void) iotc_storage_sync(cache_storage);
+        }
+    }
+}
+
+// Adds a reference to the current profile, or returns NULL if there is none
+static SyncProfileBlock* profile_acquire_block(void) {
+    SyncProfileBlock* b;
+    taskENTER_CRITICAL();
+    b = current_profile;
+    if (b) {
+        b->refs++;
+    }
+    taskEXIT_CRITICAL();
+    return b;
+}
+
+static void profile_release_block(SyncProfileBlock* b) {
+    bool last;
+    if (!b) {
+        return;
+    }
+    taskENTER_CRITICAL();
+    last = (0 == --b->refs);
+    taskEXIT_CRITICAL();
+    if (last) {
+        free(b);
+    }
+}
+
+// Makes b the current profile. The current profile holds one reference, which is passed to this function.
+static void profile_swap(SyncProfileBlock* b) {
+    SyncProfileBlock* old;
+    taskENTER_CRITICAL();
+    old = current_profile;
+    current_profile = b;
+    taskEXIT_CRITICAL();
+    profile_release_block(old);
+}
+
+static char* profile_copy(char** p, const char* str, size_t* len) {
+    char* ret = *p;
+    *len = str ? strlen(str) : 0;
+    memcpy(ret, str ? str : "", *len);
+    ret[*len] = 0;
+    *p += *len + 1;
+    return ret;
+}
+
+// Copies the broker settings into a single allocation with one reference
+static SyncProfileBlock* profile_create(const IotclSyncResponse* r, uint32_t df) {
+    const char* strings[] = { r->broker.host, r->broker.client_id, r->broker.user_name, r->broker.pub_topic, r->broker.sub_topic, r->dtg };
+    size_t size = sizeof(SyncProfileBlock);
+    size_t len;
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        size += (strings[i] ? strlen(strings[i]) : 0) + 1;
+    }
+    if (!r->broker.pub_topic || strlen(r->broker.pub_topic) > UINT16_MAX || !r->broker.sub_topic || strlen(r->broker.sub_topic) > UINT16_MAX) {
+        printf("Sync response has invalid topics\r\n");
+        return NULL;
+    }
+
+    SyncProfileBlock* b = malloc(size);
+    if (!b) {
+        printf("Failed to allocate the sync profile\r\n");
+        return NULL;
+    }
+    char* p = (char*) &b[1];
+    IotConnectSyncProfile* profile = &b->profile;
+    profile->host = profile_copy(&p, r->broker.host, &profile->host_len);
+    profile->client_id = profile_copy(&p, r->broker.client_id, &profile->client_id_len);
+    profile->user_name = profile_copy(&p, r->broker.user_name, &profile->user_name_len);
+    profile->pub_topic = profile_copy(&p, r->broker.pub_topic, &len);
+    profile->pub_topic_len = (uint16_t) len;
+    profile->sub_topic = profile_copy(&p, r->broker.sub_topic, &len);
+    profile->sub_topic_len = (uint16_t) len;
+    profile->dtg = profile_copy(&p, r->dtg, &len);
+    profile->data_frequency = df;
+    profile->version = ++profile_version;
+    b->refs = 1;
+    b->pinned = false;
+    return b;
+}
+
+const IotConnectSyncProfile* iotc_sync_acquire_profile(void) {
+    SyncProfileBlock* b = profile_acquire_block();
+    return b ? &b->profile : NULL;
+}
+
+void iotc_sync_release_profile(const IotConnectSyncProfile* profile) {
+    // the profile is the first member of the block
+    profile_release_block((SyncProfileBlock*) profile);
+}
 
+const IotConnectSyncProfile* iotc_sync_retain_profile(const IotConnectSyncProfile* profile) {
+    if (profile) {
+        taskENTER_CRITICAL();
+        ((SyncProfileBlock*) profile)->refs++;
+        taskEXIT_CRITICAL();
+    }
+    return profile;
+}
+
+// The legacy getters return pointers that the caller may keep, like the MQTT agent's connect info,
+// so the profile that they come from is never freed.
+static const IotConnectSyncProfile* profile_pinned(void) {
+    SyncProfileBlock* b;
+    taskENTER_CRITICAL();
+    b = current_profile;
+    if (b && !b->pinned) {
+        b->pinned = true;
+        b->refs++;
+    }
+    taskEXIT_CRITICAL();
+    return b ? &b->profile : NULL;
 }
 
 const char* iotc_sync_get_iothub_host() {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.host;
+    const IotConnectSyncProfile* p = profile_pinned();
+    return p ? p->host : NULL;
 }
 
 const char* iotc_sync_get_username() {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.user_name;
+    const IotConnectSyncProfile* p = profile_pinned();
+    return p ? p->user_name : NULL;
 }
 
 const char* iotc_sync_get_client_id() {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.client_id;
+    const IotConnectSyncProfile* p = profile_pinned();
+    return p ? p->client_id : NULL;
 }
 
 const char* iotc_sync_get_pub_topic(void) {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.pub_topic;
+    const IotConnectSyncProfile* p = profile_pinned();
+    return p ? p->pub_topic : NULL;
 }
 
 const char* iotc_sync_get_sub_topic(void) {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.sub_topic;
+    const IotConnectSyncProfile* p = profile_pinned();
+    return p ? p->sub_topic : NULL;
 }
 
-
 const char* iotc_sync_get_dtg(void) {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->dtg;
+    const IotConnectSyncProfile* p = profile_pinned();
+    return p ? p->dtg : NULL;
 }
 
+uint32_t iotc_sync_get_data_frequency(void) {
+    SyncProfileBlock* b = profile_acquire_block();
+    uint32_t df = b ? b->profile.data_frequency : 0;
+    profile_release_block(b);
+    return df;
+}
 
-int iotc_sync_obtain_response(void) {
-    iotcl_discovery_free_discovery_response(discovery_response);
-    iotcl_discovery_free_sync_response(sync_response);
-    discovery_response = NULL;
-    sync_response = NULL;
+static IotclSyncResponse* run_full_sync(int* ret) {
+    IotclSyncResponse* response = NULL;
 
+    uint32_t start = iotc_metrics_start();
     discovery_response = run_http_discovery(IOTCONNECT_CPID, IOTCONNECT_ENV);
+    iotc_metrics_end(IOTC_METRIC_DISCOVERY, start, NULL != discovery_response);
     if (NULL == discovery_response) {
         // get_base_url will print the error
-        return -1;
+        *ret = -1;
+        return NULL;
     }
     printf("Discovery response parsing successful.\r\n");
 
-    sync_response = run_http_sync(IOTCONNECT_CPID, IOTCONNECT_DUID);
-    if (NULL == sync_response) {
+    start = iotc_metrics_start();
+    response = run_http_sync(IOTCONNECT_CPID, IOTCONNECT_DUID);
+    iotc_metrics_end(IOTC_METRIC_SYNC, start, NULL != response);
+    iotcl_discovery_free_discovery_response(discovery_response);
+    discovery_response = NULL;
+    if (NULL == response) {
         // Sync_call will print the error
-        return -2;
+        *ret = -2;
+        return NULL;
     }
     printf("Sync response parsing successful.\r\n");
 
-    return (sync_response ? EXIT_SUCCESS : EXIT_FAILURE);
+    cache_save(response);
+    cache_invalidated = false;
+    *ret = EXIT_SUCCESS;
+    return response;
 }
- 
-void iotc_sync_free_response(void) {
-    if (sync_response) {
-        free(sync_response);
+
+static void sync_init_lock(void) {
+    taskENTER_CRITICAL();
+    if (NULL == sync_lock) {
+        sync_lock = xSemaphoreCreateMutexStatic(&sync_lock_storage);
     }
-    if (discovery_response) {
-        free(discovery_response);
+    taskEXIT_CRITICAL();
+}
+
+int iotc_sync_obtain_response(void) {
+    int ret = EXIT_SUCCESS;
+    TickType_t start = xTaskGetTickCount();
+
+    sync_init_lock();
+    xSemaphoreTake(sync_lock, portMAX_DELAY);
+
+    IotclSyncResponse* response = cache_load();
+    bool from_cache = (NULL != response);
+    if (from_cache) {
+        last_sync_result = IOTCL_SR_OK;
+    } else {
+        response = run_full_sync(&ret);
     }
-    discovery_response = NULL;
-    sync_response = NULL;
+
+    if (response) {
+        SyncProfileBlock* b = profile_create(response, data_frequency);
+        iotcl_discovery_free_sync_response(response);
+        if (b) {
+            profile_swap(b);
+        } else {
+            ret = EXIT_FAILURE;
+        }
+    }
+    xSemaphoreGive(sync_lock);
+
+    printf("%s sync %s in %lu ms.\r\n",
+        from_cache ? "Cached" : "Full",
+        ret ? "failed" : "completed",
+        (unsigned long) ((xTaskGetTickCount() - start) * portTICK_PERIOD_MS)
+    );
+    return ret;
+}
+
+void iotc_sync_free_response(void) {
+    profile_swap(NULL);
     last_sync_result = IOTCL_SR_UNKNOWN_DEVICE_STATUS;
+    data_frequency = 0;
+}
+
+static void resync_task(void* pvParameters) {
+    (void) pvParameters;
+
+    for (;;) {
+        (void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t old_version = 0;
+        SyncProfileBlock* old = profile_acquire_block();
+        if (old) {
+            old_version = old->profile.version;
+        }
+
+        iotc_sync_invalidate_cache();
+        if (iotc_sync_obtain_response()) {
+            // keep the current profile. The next request or reconnect will try again.
+            printf("Background sync failed. Keeping the current broker settings.\r\n");
+        } else {
+            SyncProfileBlock* b = profile_acquire_block();
+            if (b && old && (strcmp(b->profile.host, old->profile.host) || strcmp(b->profile.sub_topic, old->profile.sub_topic)
+                             || strcmp(b->profile.client_id, old->profile.client_id))) {
+                printf("WARN: Broker settings changed with the sync. They will be used after a reconnect.\r\n");
+            }
+            printf("Sync profile version %lu replaced version %lu.\r\n",
+                (unsigned long) (b ? b->profile.version : 0), (unsigned long) old_version);
+            profile_release_block(b);
+        }
+        profile_release_block(old);
+    }
+}
+
+int iotc_sync_request_resync(void) {
+    if (NULL == resync_task_handle) {
+        if (pdPASS != xTaskCreate(resync_task, "IoTC-Sync", IOTC_SYNC_TASK_STACK_SIZE, NULL, IOTC_SYNC_TASK_PRIORITY, &resync_task_handle)) {
+            printf("Failed to create the sync task\r\n");
+            return EXIT_FAILURE;
+        }
+    }
+    // requests made while a sync is running are merged into one more sync
+    (void) xTaskNotifyGive(resync_task_handle);
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,591 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotconnect_lib.h"
+#include "iotconnect_telemetry_writer.h"
+#include "iotconnect_timestamp.h"
+
+#ifndef CONFIG_IOTCONNECT_SDK_NAME
+#define CONFIG_IOTCONNECT_SDK_NAME "M_C"
+#endif
+
+#ifndef CONFIG_IOTCONNECT_SDK_VERSION
+#define CONFIG_IOTCONNECT_SDK_VERSION "2.0"
+#endif
+
+#if IOTC_TELEMETRY_WRITER_CBOR
+// CBOR major types and the simple values that we use
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT 3
+#define CBOR_MAP_START 0xbf // indefinite length, so the entries do not need to be counted up front
+#define CBOR_ARRAY_START 0x9f
+#define CBOR_BREAK 0xff
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_FLOAT32 0xfa
+#define CBOR_FLOAT64 0xfb
+#endif
+
+static void write_raw(IotConnectTelemetryWriter *w, const char *str, size_t len) {
+    if (w->overflow) {
+        return;
+    }
+    // always leave room for the null terminator
+    if (w->len + len >= w->size) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(&w->buf[w->len], str, len);
+    w->len += len;
+}
+
+#if IOTC_TELEMETRY_WRITER_CBOR
+
+static void write_byte(IotConnectTelemetryWriter *w, uint8_t b) {
+    write_raw(w, (const char *) &b, 1);
+}
+
+// Writes the value big endian in the given number of bytes
+static void write_be(IotConnectTelemetryWriter *w, uint64_t value, unsigned int bytes) {
+    char be[8];
+    for (unsigned int i = 0; i < bytes; i++) {
+        be[i] = (char) (value >> (8 * (bytes - 1 - i)));
+    }
+    write_raw(w, be, bytes);
+}
+
+// Initial byte of a data item with the argument in the shortest form
+static void write_head(IotConnectTelemetryWriter *w, uint8_t major, uint64_t value) {
+    if (value < 24) {
+        write_byte(w, (uint8_t) (major << 5 | value));
+    } else if (value <= UINT8_MAX) {
+        write_byte(w, (uint8_t) (major << 5 | 24));
+        write_be(w, value, 1);
+    } else if (value <= UINT16_MAX) {
+        write_byte(w, (uint8_t) (major << 5 | 25));
+        write_be(w, value, 2);
+    } else if (value <= UINT32_MAX) {
+        write_byte(w, (uint8_t) (major << 5 | 26));
+        write_be(w, value, 4);
+    } else {
+        write_byte(w, (uint8_t) (major << 5 | 27));
+        write_be(w, value, 8);
+    }
+}
+
+static void write_string(IotConnectTelemetryWriter *w, const char *str) {
+    if (!str) {
+        str = ""; // like an unset dtg before the sync
+    }
+    size_t len = strlen(str);
+    write_head(w, CBOR_TEXT, len);
+    write_raw(w, str, len);
+}
+
+static void write_key(IotConnectTelemetryWriter *w, const char *name) {
+    write_string(w, name);
+    w->num_values++;
+}
+
+// Integers in the shortest form, and the rest as single precision when that loses nothing
+static void write_number(IotConnectTelemetryWriter *w, double value) {
+    if (isnan(value) || isinf(value)) {
+        write_byte(w, CBOR_NULL); // same as the JSON form
+        return;
+    }
+    if (fabs(value) < 1e15 && value == (double) (long long) value) {
+        long long i = (long long) value;
+        if (i >= 0) {
+            write_head(w, CBOR_UINT, (uint64_t) i);
+        } else {
+            write_head(w, CBOR_NEGINT, (uint64_t) (-1 - i));
+        }
+        return;
+    }
+    float f = (float) value;
+    if ((double) f == value) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        write_byte(w, CBOR_FLOAT32);
+        write_be(w, bits, 4);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        write_byte(w, CBOR_FLOAT64);
+        write_be(w, bits, 8);
+    }
+}
+
+static void write_bool(IotConnectTelemetryWriter *w, bool value) {
+    write_byte(w, value ? CBOR_TRUE : CBOR_FALSE);
+}
+
+static void write_null(IotConnectTelemetryWriter *w) {
+    write_byte(w, CBOR_NULL);
+}
+
+#else // JSON
+
+static void write_str(IotConnectTelemetryWriter *w, const char *str) {
+    write_raw(w, str, strlen(str));
+}
+
+static void write_string(IotConnectTelemetryWriter *w, const char *str) {
+    const char *run;
+    const char *p;
+
+    if (!str) {
+        str = ""; // like an unset dtg before the sync
+    }
+    run = str; // start of the run of characters that do not need escaping
+    write_raw(w, "\"", 1);
+    for (p = str; *p; p++) {
+        unsigned char c = (unsigned char) *p;
+        char esc[7];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        write_raw(w, run, (size_t) (p - run));
+        run = p + 1;
+        switch (c) {
+            case '"':  write_raw(w, "\\\"", 2); break;
+            case '\\': write_raw(w, "\\\\", 2); break;
+            case '\b': write_raw(w, "\\b", 2); break;
+            case '\f': write_raw(w, "\\f", 2); break;
+            case '\n': write_raw(w, "\\n", 2); break;
+            case '\r': write_raw(w, "\\r", 2); break;
+            case '\t': write_raw(w, "\\t", 2); break;
+            default:
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                write_raw(w, esc, 6);
+                break;
+        }
+    }
+    write_raw(w, run, (size_t) (p - run));
+    write_raw(w, "\"", 1);
+}
+
+static void write_key(IotConnectTelemetryWriter *w, const char *name) {
+    if (w->num_values > 0) {
+        write_raw(w, ",", 1);
+    }
+    write_string(w, name);
+    write_raw(w, ":", 1);
+    w->num_values++;
+}
+
+// Same number format that cJSON would produce
+static void write_number(IotConnectTelemetryWriter *w, double value) {
+    char num[32];
+    int num_len;
+
+    if (isnan(value) || isinf(value)) {
+        write_raw(w, "null", 4);
+        return;
+    }
+    if (fabs(value) < 1e15 && value == (double) (long long) value) { // check the range first. The cast is undefined out of range.
+        num_len = snprintf(num, sizeof(num), "%lld", (long long) value);
+    } else {
+        num_len = snprintf(num, sizeof(num), "%1.15g", value);
+        if (strtod(num, NULL) != value) {
+            num_len = snprintf(num, sizeof(num), "%1.17g", value);
+        }
+    }
+    write_raw(w, num, (size_t) num_len);
+}
+
+static void write_bool(IotConnectTelemetryWriter *w, bool value) {
+    write_str(w, value ? "true" : "false");
+}
+
+static void write_null(IotConnectTelemetryWriter *w) {
+    write_raw(w, "null", 4);
+}
+
+#endif // IOTC_TELEMETRY_WRITER_CBOR
+
+static bool value_allowed(IotConnectTelemetryWriter *w, const char *name) {
+    if (!w || !name || 0 == w->num_points) {
+        return false;
+    }
+    return !w->overflow;
+}
+
+bool iotc_telemetry_writer_init(IotConnectTelemetryWriter *w, char *buf, size_t size) {
+    IotclConfig *config = iotcl_get_config();
+
+    if (!w || !buf || !size || !config) {
+        return false;
+    }
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->size = size;
+
+#if IOTC_TELEMETRY_WRITER_CBOR
+    write_byte(w, CBOR_MAP_START);
+    write_string(w, "cpId");
+    write_string(w, config->device.cpid);
+    write_string(w, "dtg");
+    write_string(w, config->telemetry.dtg);
+    write_string(w, "mt");
+    write_number(w, 0);
+    write_string(w, "sdk");
+    write_byte(w, CBOR_MAP_START);
+    write_string(w, "l");
+    write_string(w, CONFIG_IOTCONNECT_SDK_NAME);
+    write_string(w, "v");
+    write_string(w, CONFIG_IOTCONNECT_SDK_VERSION);
+    write_string(w, "e");
+    write_string(w, config->device.env);
+    write_byte(w, CBOR_BREAK);
+    write_string(w, "d");
+    write_byte(w, CBOR_ARRAY_START);
+#else
+    write_str(w, "{\"cpId\":");
+    write_string(w, config->device.cpid);
+    write_str(w, ",\"dtg\":");
+    write_string(w, config->telemetry.dtg);
+    write_str(w, ",\"mt\":0,\"sdk\":{\"l\":\"" CONFIG_IOTCONNECT_SDK_NAME "\",\"v\":\"" CONFIG_IOTCONNECT_SDK_VERSION "\",\"e\":");
+    write_string(w, config->device.env);
+    write_str(w, "},\"d\":[");
+#endif
+
+    return !w->overflow;
+}
+
+// Writes "dt" as iso_time, or as offset_ms if iso_time is NULL
+static bool begin_point(IotConnectTelemetryWriter *w, const char *iso_time, int64_t offset_ms) {
+    IotclConfig *config = iotcl_get_config();
+
+    if (!w || w->overflow || !config) {
+        return false;
+    }
+
+    if (0 == w->num_points) {
+        strncpy(w->first_time, iso_time, IOTC_TELEMETRY_WRITER_TIME_MAX_LEN);
+    }
+#if IOTC_TELEMETRY_WRITER_CBOR
+    if (w->num_points > 0) {
+        write_byte(w, CBOR_BREAK); // values
+        write_byte(w, CBOR_BREAK); // point
+    }
+    write_byte(w, CBOR_MAP_START);
+    write_string(w, "dt");
+    if (iso_time) {
+        write_string(w, iso_time);
+    } else {
+        write_number(w, (double) offset_ms);
+    }
+    write_string(w, "id");
+    write_string(w, config->device.duid);
+    write_string(w, "tg");
+    write_string(w, "");
+    write_string(w, "d");
+    write_byte(w, CBOR_MAP_START);
+#else
+    if (w->num_points > 0) {
+        write_str(w, "}},");
+    }
+    write_str(w, "{\"dt\":");
+    if (iso_time) {
+        write_string(w, iso_time);
+    } else {
+        write_number(w, (double) offset_ms);
+    }
+    write_str(w, ",\"id\":");
+    write_string(w, config->device.duid);
+    write_str(w, ",\"tg\":\"\",\"d\":{");
+#endif
+
+    w->num_points++;
+    w->num_values = 0;
+    return !w->overflow;
+}
+
+bool iotc_telemetry_writer_add_point(IotConnectTelemetryWriter *w, const char *iso_time) {
+    if (!iso_time) {
+        return iotc_telemetry_writer_add_point_at(w, iotc_timestamp_now_ms());
+    }
+    return begin_point(w, iso_time, 0);
+}
+
+bool iotc_telemetry_writer_add_point_at(IotConnectTelemetryWriter *w, uint64_t time_ms) {
+    char iso_time[IOTC_TIMESTAMP_LEN + 1];
+
+    if (!w) {
+        return false;
+    }
+#if IOTC_TELEMETRY_WRITER_RELATIVE_TIME
+    if (w->num_points > 0 && w->has_first_time_ms) {
+        return begin_point(w, NULL, (int64_t) (time_ms - w->first_time_ms));
+    }
+#endif
+    iotc_timestamp_format(time_ms, iso_time);
+    if (0 == w->num_points) {
+        w->first_time_ms = time_ms;
+        w->has_first_time_ms = true;
+    }
+    return begin_point(w, iso_time, 0);
+}
+
+bool iotc_telemetry_writer_set_number(IotConnectTelemetryWriter *w, const char *name, double value) {
+    if (!value_allowed(w, name)) {
+        return false;
+    }
+    write_key(w, name);
+    write_number(w, value);
+    return !w->overflow;
+}
+
+bool iotc_telemetry_writer_set_bool(IotConnectTelemetryWriter *w, const char *name, bool value) {
+    if (!value_allowed(w, name)) {
+        return false;
+    }
+    write_key(w, name);
+    write_bool(w, value);
+    return !w->overflow;
+}
+
+bool iotc_telemetry_writer_set_string(IotConnectTelemetryWriter *w, const char *name, const char *value) {
+    if (!value_allowed(w, name) || !value) {
+        return false;
+    }
+    write_key(w, name);
+    write_string(w, value);
+    return !w->overflow;
+}
+
+bool iotc_telemetry_writer_set_null(IotConnectTelemetryWriter *w, const char *name) {
+    if (!value_allowed(w, name)) {
+        return false;
+    }
+    write_key(w, name);
+    write_null(w);
+    return !w->overflow;
+}
+
+const char *iotc_telemetry_writer_finish(IotConnectTelemetryWriter *w, size_t *len) {
+    if (!w || 0 == w->num_points) {
+        return NULL;
+    }
+#if IOTC_TELEMETRY_WRITER_CBOR
+    write_byte(w, CBOR_BREAK); // values
+    write_byte(w, CBOR_BREAK); // point
+    write_byte(w, CBOR_BREAK); // points array
+    write_string(w, "t");
+    write_string(w, w->first_time);
+    write_byte(w, CBOR_BREAK);
+#else
+    write_str(w, "}}],\"t\":");
+    write_string(w, w->first_time);
+    write_str(w, "}");
+#endif
+    if (w->overflow) {
+        fprintf(stderr, "Error: Telemetry message does not fit into %u bytes\n", (unsigned int) w->size);
+        return NULL;
+    }
+    w->buf[w->len] = 0;
+    if (len) {
+        *len = w->len;
+    }
+    return w->buf;
+}
+
+#if IOTC_TELEMETRY_WRITER_CBOR
+
+static int hex_value(const char *p) {
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+// Decodes the JSON string that starts after the opening quote at p. If out is NULL, only the decoded length is counted.
+// Returns the position after the closing quote, or NULL if the string is not valid.
+static const char *decode_json_string(const char *p, char *out, size_t *len) {
+    size_t n = 0;
+
+    while (*p != '"') {
+        char utf8[4];
+        size_t utf8_len = 1;
+
+        if (!*p) {
+            return NULL;
+        }
+        if (*p != '\\') {
+            utf8[0] = *p++;
+        } else {
+            p++;
+            switch (*p) {
+                case '"': case '\\': case '/': utf8[0] = *p; break;
+                case 'b': utf8[0] = '\b'; break;
+                case 'f': utf8[0] = '\f'; break;
+                case 'n': utf8[0] = '\n'; break;
+                case 'r': utf8[0] = '\r'; break;
+                case 't': utf8[0] = '\t'; break;
+                case 'u': {
+                    long cp = hex_value(p + 1);
+                    if (cp < 0) {
+                        return NULL;
+                    }
+                    p += 4;
+                    if (cp >= 0xd800 && cp <= 0xdbff && p[1] == '\\' && p[2] == 'u') {
+                        long low = hex_value(p + 3);
+                        if (low >= 0xdc00 && low <= 0xdfff) {
+                            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                            p += 6;
+                        }
+                    }
+                    if (cp < 0x80) {
+                        utf8[0] = (char) cp;
+                    } else if (cp < 0x800) {
+                        utf8[0] = (char) (0xc0 | (cp >> 6));
+                        utf8[1] = (char) (0x80 | (cp & 0x3f));
+                        utf8_len = 2;
+                    } else if (cp < 0x10000) {
+                        utf8[0] = (char) (0xe0 | (cp >> 12));
+                        utf8[1] = (char) (0x80 | ((cp >> 6) & 0x3f));
+                        utf8[2] = (char) (0x80 | (cp & 0x3f));
+                        utf8_len = 3;
+                    } else {
+                        utf8[0] = (char) (0xf0 | (cp >> 18));
+                        utf8[1] = (char) (0x80 | ((cp >> 12) & 0x3f));
+                        utf8[2] = (char) (0x80 | ((cp >> 6) & 0x3f));
+                        utf8[3] = (char) (0x80 | (cp & 0x3f));
+                        utf8_len = 4;
+                    }
+                    break;
+                }
+                default:
+                    return NULL;
+            }
+            p++;
+        }
+        if (out) {
+            memcpy(&out[n], utf8, utf8_len);
+        }
+        n += utf8_len;
+    }
+    *len = n;
+    return p + 1;
+}
+
+// Writes the decoded string straight into the buffer, after its head
+static const char *encode_json_string(IotConnectTelemetryWriter *w, const char *p) {
+    size_t len;
+
+    if (!decode_json_string(p, NULL, &len)) {
+        return NULL;
+    }
+    write_head(w, CBOR_TEXT, len);
+    if (w->overflow || w->len + len >= w->size) {
+        w->overflow = true;
+        return NULL;
+    }
+    p = decode_json_string(p, &w->buf[w->len], &len);
+    w->len += len;
+    return p;
+}
+
+const char *iotc_telemetry_writer_encode_json(char *buf, size_t size, const char *json, size_t *len) {
+    IotConnectTelemetryWriter w;
+    const char *p = json;
+
+    if (!buf || !size || !json) {
+        return NULL;
+    }
+    memset(&w, 0, sizeof(w));
+    w.buf = buf;
+    w.size = size;
+
+    // The structure is not checked. The message comes from a JSON serializer, so it is well formed.
+    while (*p && !w.overflow) {
+        char c = *p;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ':') {
+            p++;
+        } else if (c == '{') {
+            write_byte(&w, CBOR_MAP_START);
+            p++;
+        } else if (c == '[') {
+            write_byte(&w, CBOR_ARRAY_START);
+            p++;
+        } else if (c == '}' || c == ']') {
+            write_byte(&w, CBOR_BREAK);
+            p++;
+        } else if (c == '"') {
+            p = encode_json_string(&w, p + 1);
+            if (!p) {
+                break;
+            }
+        } else if (0 == strncmp(p, "true", 4)) {
+            write_bool(&w, true);
+            p += 4;
+        } else if (0 == strncmp(p, "false", 5)) {
+            write_bool(&w, false);
+            p += 5;
+        } else if (0 == strncmp(p, "null", 4)) {
+            write_null(&w);
+            p += 4;
+        } else {
+            char *end;
+            double value = strtod(p, &end);
+            if (end == p) {
+                p = NULL;
+                break;
+            }
+            write_number(&w, value);
+            p = end;
+        }
+    }
+    if (!p || w.overflow) {
+        fprintf(stderr, "Error: Unable to convert the telemetry message to CBOR\n");
+        return NULL;
+    }
+    buf[w.len] = 0;
+    if (len) {
+        *len = w.len;
+    }
+    return buf;
+}
+
+#else // JSON
+
+const char *iotc_telemetry_writer_encode_json(char *buf, size_t size, const char *json, size_t *len) {
+    size_t json_len;
+
+    if (!buf || !json) {
+        return NULL;
+    }
+    json_len = strlen(json);
+    if (json_len >= size) {
+        fprintf(stderr, "Error: Telemetry message does not fit into %u bytes\n", (unsigned int) size);
+        return NULL;
+    }
+    memcpy(buf, json, json_len + 1);
+    if (len) {
+        *len = json_len;
+    }
+    return buf;
+}
+
+#endif // IOTC_TELEMETRY_WRITER_CBOR
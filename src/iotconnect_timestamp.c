@@ -0,0 +1,101 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "iotconnect_timestamp.h"
+
+// Characters of "2022-06-15T12:34:" that stay the same for a minute
+#define TIMESTAMP_PREFIX_LEN 17
+
+// Both are shared by all tasks, and are updated in short critical sections.
+static struct {
+    int64_t offset_ms; // wall clock time at tick 0
+    uint64_t resync_ms; // tick time of the last comparison with time()
+    TickType_t last_ticks;
+    uint32_t wraps; // of the tick count
+    bool synced;
+    bool wall_clock_set; // time() was past IOTC_TIMESTAMP_MIN_VALID_TIME at the last comparison
+} clock_state;
+
+static struct {
+    uint64_t minute; // since the epoch
+    char text[TIMESTAMP_PREFIX_LEN];
+    bool valid;
+} prefix_cache;
+
+uint64_t iotc_timestamp_now_ms(void) {
+    taskENTER_CRITICAL();
+    TickType_t ticks = xTaskGetTickCount();
+    if (ticks < clock_state.last_ticks) {
+        clock_state.wraps++;
+    }
+    clock_state.last_ticks = ticks;
+    uint64_t tick_ms = ((uint64_t) clock_state.wraps * ((uint64_t) portMAX_DELAY + 1) + ticks) * portTICK_PERIOD_MS;
+    // Until the wall clock is set, like before the first SNTP update, compare on every call, so that it is picked up right away
+    bool resync = !clock_state.wall_clock_set || tick_ms - clock_state.resync_ms >= IOTC_TIMESTAMP_RESYNC_MS;
+    int64_t offset_ms = clock_state.offset_ms;
+    taskEXIT_CRITICAL();
+
+    if (resync) {
+        // time() counts whole seconds, so the clock is in sync if it is up to a second ahead of it
+        time_t wall = time(NULL);
+        int64_t wall_ms = (int64_t) wall * 1000;
+        int64_t now_ms = offset_ms + (int64_t) tick_ms;
+        taskENTER_CRITICAL();
+        if (!clock_state.synced || now_ms < wall_ms || now_ms >= wall_ms + 1000) {
+            clock_state.offset_ms = wall_ms - (int64_t) tick_ms;
+            clock_state.synced = true;
+        }
+        clock_state.resync_ms = tick_ms;
+        clock_state.wall_clock_set = wall >= IOTC_TIMESTAMP_MIN_VALID_TIME;
+        offset_ms = clock_state.offset_ms;
+        taskEXIT_CRITICAL();
+    }
+    return (uint64_t) (offset_ms + (int64_t) tick_ms);
+}
+
+void iotc_timestamp_format(uint64_t time_ms, char *buf) {
+    uint64_t seconds = time_ms / 1000;
+    uint64_t minute = seconds / 60;
+    bool cached;
+
+    taskENTER_CRITICAL();
+    cached = prefix_cache.valid && prefix_cache.minute == minute;
+    if (cached) {
+        memcpy(buf, prefix_cache.text, TIMESTAMP_PREFIX_LEN);
+    }
+    taskEXIT_CRITICAL();
+
+    if (!cached) {
+        time_t t = (time_t) seconds;
+        struct tm tm;
+        if (!gmtime_r(&t, &tm) || strftime(buf, TIMESTAMP_PREFIX_LEN + 1, "%Y-%m-%dT%H:%M:", &tm) != TIMESTAMP_PREFIX_LEN) {
+            memcpy(buf, "1970-01-01T00:00:", TIMESTAMP_PREFIX_LEN); // not representable with a four digit year
+        } else {
+            taskENTER_CRITICAL();
+            memcpy(prefix_cache.text, buf, TIMESTAMP_PREFIX_LEN);
+            prefix_cache.minute = minute;
+            prefix_cache.valid = true;
+            taskEXIT_CRITICAL();
+        }
+    }
+
+    unsigned int s = (unsigned int) (seconds % 60);
+    unsigned int ms = (unsigned int) (time_ms % 1000);
+    char *p = buf + TIMESTAMP_PREFIX_LEN;
+    p[0] = (char) ('0' + s / 10);
+    p[1] = (char) ('0' + s % 10);
+    p[2] = '.';
+    p[3] = (char) ('0' + ms / 100);
+    p[4] = (char) ('0' + ms / 10 % 10);
+    p[5] = (char) ('0' + ms % 10);
+    p[6] = 'Z';
+    p[7] = 0;
+}